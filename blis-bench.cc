@@ -6,19 +6,33 @@
 // - blis:           1213 ms
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <blis/blis.h>
 
-int main() {
-    const long batch = 512;
-    const dim_t m = 1000, n = 240, k = 200;
+// args: batch, m, n, k
+int main(int argc, char* argv[]) {
+    // default batch size and matrix shape
+    long batch = 512;
+    dim_t m = 1000, n = 240, k = 200;
+    if (argc == 5) {
+        batch = atol(argv[1]);
+        m = atol(argv[2]);
+        n = atol(argv[3]);
+        k = atol(argv[4]);
+        if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+            fprintf(stderr, "invalid size\n");
+            return 1;
+        }
+    }
+    printf("batch=%ld, m=%ld, n=%ld, k=%ld\n", batch, (long)m, (long)n, (long)k);
 
     float *a = malloc(batch*m*k*sizeof(float));
     float *b = malloc(batch*k*n*sizeof(float));
     float *c = malloc(batch*m*n*sizeof(float));
 
-    for(int i = 0; i < batch*m*k; i++) a[i] = (float)i;
-    for(int i = 0; i < batch*k*n; i++) b[i] = (float)i;
+    for(long i = 0; i < batch*m*k; i++) a[i] = (float)i;
+    for(long i = 0; i < batch*k*n; i++) b[i] = (float)i;
 
     float alpha = 1.0f;
     float beta = 0.0f;
@@ -47,7 +61,7 @@ int main() {
 
     // print some results for quick debugging
     printf("c[0]    = %e\n", c[0]);
-    printf("c[9973] = %e\n", c[9973]);
+    if (batch*m*n > 9973) printf("c[9973] = %e\n", c[9973]);
     printf("c[-1]   = %e\n", c[batch*m*n-1]);
 
     free(a);
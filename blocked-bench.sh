@@ -0,0 +1,24 @@
+#!/bin/bash -e
+
+# compare cache blocked kernel against tile-transpose and blis on large
+# square matrices, single thread
+# "batch|m,n,k"
+batch_shapes=(
+    "8|512,512,512"
+    "4|1024,1024,1024"
+    "1|2048,2048,2048"
+    "1|3072,3072,3072"
+    "1|4096,4096,4096"
+)
+
+make mm-bench blis-bench
+
+for batch_shape in "${batch_shapes[@]}"; do
+    IFS="|," read -r batch m n k <<< "${batch_shape}"
+    echo "============================================================="
+    echo "batch=${batch}, m=${m}, n=${n}, k=${k}"
+    ./mm-bench tile-transpose ${batch} ${m} ${n} ${k} 2>/dev/null
+    ./mm-bench blocked ${batch} ${m} ${n} ${k} 2>/dev/null
+    echo "========== blis =========="
+    ./blis-bench ${batch} ${m} ${n} ${k} | grep time
+done
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// minimal aarch64 code emitter for the jit kernels
+// - only the instructions the kernels need, all 64 bit general registers
+// - x: general register number 0 ~ 30, v/q: vector register number 0 ~ 31
+// - branch targets are instruction indexes returned by pos()
+// - x16 is the scratch register of add_imm
+class Assembler {
+ public:
+  size_t pos() const { return code_.size(); }
+  const std::vector<uint32_t>& code() const { return code_; }
+
+  // movi vd.4s, #0
+  void movi_zero(int vd) { emit(0x4f000400 | vd); }
+
+  // fmla vd.4s, vn.4s, vm.s[lane]
+  void fmla(int vd, int vn, int vm, int lane) {
+    emit(0x4f801000 | (lane & 1) << 21 | vm << 16 | (lane >> 1) << 11 |
+         vn << 5 | vd);
+  }
+
+  // ldp qt1, qt2, [xn], #imm
+  void ldp_q_post(int qt1, int qt2, int xn, int imm) {
+    emit(0xacc00000 | (imm / 16 & 0x7f) << 15 | qt2 << 10 | xn << 5 | qt1);
+  }
+
+  // ldr qt, [xn], #imm
+  void ldr_q_post(int qt, int xn, int imm) {
+    emit(0x3cc00400 | (imm & 0x1ff) << 12 | xn << 5 | qt);
+  }
+
+  // stp qt1, qt2, [xn, #imm], imm: -1024 ~ 1008, multiple of 16
+  void stp_q(int qt1, int qt2, int xn, int imm) {
+    emit(0xad000000 | (imm / 16 & 0x7f) << 15 | qt2 << 10 | xn << 5 | qt1);
+  }
+
+  // str qt, [xn, #imm], imm: 0 ~ 65520, multiple of 16
+  void str_q(int qt, int xn, int imm) {
+    emit(0x3d800000 | (imm / 16) << 10 | xn << 5 | qt);
+  }
+
+  // mov xd, xn
+  void mov(int xd, int xn) { emit(0xaa0003e0 | xn << 16 | xd); }
+
+  // mov xd, #imm by movz and movk
+  void mov_imm(int xd, uint64_t imm) {
+    emit(0xd2800000 | (imm & 0xffff) << 5 | xd);
+    for (int hw = 1; hw < 4; ++hw) {
+      const uint64_t part = imm >> (hw * 16) & 0xffff;
+      if (part) emit(0xf2800000 | hw << 21 | part << 5 | xd);
+    }
+  }
+
+  // xd = xn + imm, imm >= 0
+  void add_imm(int xd, int xn, uint64_t imm) {
+    if (imm >= 1 << 24) {
+      mov_imm(16, imm);
+      emit(0x8b000000 | 16 << 16 | xn << 5 | xd);  // add xd, xn, x16
+      return;
+    }
+    if (imm >> 12) {
+      emit(0x91400000 | (imm >> 12) << 10 | xn << 5 | xd);
+      xn = xd;
+    }
+    if (imm & 0xfff || xn != xd) {
+      emit(0x91000000 | (imm & 0xfff) << 10 | xn << 5 | xd);
+    }
+  }
+
+  // subs xd, xn, #imm, imm: 0 ~ 4095
+  void subs_imm(int xd, int xn, int imm) {
+    emit(0xf1000000 | imm << 10 | xn << 5 | xd);
+  }
+
+  // b.ne target
+  void b_ne(size_t target) {
+    const int32_t offset = static_cast<int32_t>(target - pos());
+    emit(0x54000001 | (offset & 0x7ffff) << 5);
+  }
+
+  void ret() { emit(0xd65f03c0); }
+
+  // copy the code to a new read + execute mapping, nullptr on failure
+  // - never unmapped, jit kernels live as long as the process
+  void* finalize() const {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t bytes = (code_.size() * 4 + page - 1) / page * page;
+    void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return nullptr;
+    std::memcpy(mem, code_.data(), code_.size() * 4);
+    if (mprotect(mem, bytes, PROT_READ | PROT_EXEC)) {
+      munmap(mem, bytes);
+      return nullptr;
+    }
+    char* begin = static_cast<char*>(mem);
+    __builtin___clear_cache(begin, begin + code_.size() * 4);
+    return mem;
+  }
+
+ private:
+  void emit(uint32_t inst) { code_.push_back(inst); }
+
+  std::vector<uint32_t> code_;
+};
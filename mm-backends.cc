@@ -0,0 +1,107 @@
+// other gemm libraries as mm_func backends of mm-bench, so they run under
+// the same timer, data, layout and verification as the kernels of mm.cc
+// - blis and onednn are optional, enabled by the Makefile if they are built
+//   (MM_HAVE_BLIS, MM_HAVE_ONEDNN), see the Makefile for how to build them
+// - llamafile is a header, always built
+// - every backend computes row major c = a * b from row major a and b, any
+//   layout change a library needs is done inside the call and timed
+
+#include <vector>
+
+#ifdef MM_HAVE_BLIS
+#include <blis/blis.h>
+#endif
+
+#ifdef MM_HAVE_ONEDNN
+#include <map>
+#include <tuple>
+#include <dnnl.hpp>
+#endif
+
+// last, it defines short macros (V, D, TA, ...)
+#include "llamafile.h"
+
+// llamafile SGEMMER: column major C = A * B, A and B given as rows of k,
+// k % 4 == 0
+// - row major c = a * b is c transposed in column major, so A is b
+//   transposed (n rows of k) and B is a
+// - b is transposed every call, a is copied only if k is padded to 4
+static void mm_llamafile(const float* a, const float* b, float* c,
+                         int m, int n, int k) {
+  const int k_pad = (k + KN - 1) / KN * KN;
+  static thread_local std::vector<float> ws;
+  const size_t bt_size = static_cast<size_t>(n) * k_pad;
+  ws.resize(bt_size + (k_pad != k ? static_cast<size_t>(m) * k_pad : 0));
+  float* bt = ws.data();
+  for (int row = 0; row < k_pad; ++row) {
+    for (int col = 0; col < n; ++col) {
+      bt[static_cast<long>(col) * k_pad + row] =
+          row < k ? b[static_cast<long>(row) * n + col] : 0.f;
+    }
+  }
+  if (k_pad != k) {
+    float* a_pad = bt + bt_size;
+    for (int row = 0; row < m; ++row) {
+      for (int col = 0; col < k_pad; ++col) {
+        a_pad[static_cast<long>(row) * k_pad + col] =
+            col < k ? a[static_cast<long>(row) * k + col] : 0.f;
+      }
+    }
+    a = a_pad;
+  }
+  SGEMMER tb{k_pad, bt, k_pad, a, k_pad, c, n, 0, 1};
+  tb.matmul(n, m);
+}
+
+#ifdef MM_HAVE_BLIS
+// blis sgemm with row strides, single thread unless enabled in blis
+static void mm_blis(const float* a, const float* b, float* c,
+                    int m, int n, int k) {
+  float alpha = 1.f, beta = 0.f;
+  bli_sgemm(BLIS_NO_TRANSPOSE, BLIS_NO_TRANSPOSE, m, n, k, &alpha,
+            const_cast<float*>(a), k, 1, const_cast<float*>(b), n, 1, &beta,
+            c, n, 1);
+}
+#endif
+
+#ifdef MM_HAVE_ONEDNN
+// onednn matmul, the acl path on arm (dnnl_sgemm would not take it)
+// - one primitive per shape, created at the first call of the shape
+// - memory objects wrap the caller's buffers, no copy
+// - one execute per matrix, where onednn-bench.cc runs the whole batch as
+//   one 3d matmul
+static void mm_onednn(const float* a, const float* b, float* c,
+                      int m, int n, int k) {
+  using namespace dnnl;
+  static engine eng(engine::kind::cpu, 0);
+  static stream strm(eng);
+  static std::map<std::tuple<int, int, int>, matmul> prims;
+
+  const memory::desc a_md({m, k}, memory::data_type::f32,
+                          memory::format_tag::ab);
+  const memory::desc b_md({k, n}, memory::data_type::f32,
+                          memory::format_tag::ab);
+  const memory::desc c_md({m, n}, memory::data_type::f32,
+                          memory::format_tag::ab);
+  auto it = prims.find({m, n, k});
+  if (it == prims.end()) {
+    it = prims.emplace(std::make_tuple(m, n, k),
+                       matmul(matmul::primitive_desc(eng, a_md, b_md, c_md)))
+             .first;
+  }
+  it->second.execute(strm, {
+      {DNNL_ARG_SRC, memory(a_md, eng, const_cast<float*>(a))},
+      {DNNL_ARG_WEIGHTS, memory(b_md, eng, const_cast<float*>(b))},
+      {DNNL_ARG_DST, memory(c_md, eng, c)},
+  });
+  strm.wait();
+}
+#endif
+
+auto _mm_llamafile = mm_llamafile;
+#ifdef MM_HAVE_BLIS
+auto _mm_blis = mm_blis;
+#endif
+#ifdef MM_HAVE_ONEDNN
+auto _mm_onednn = mm_onednn;
+#endif
@@ -8,12 +8,30 @@
 // - tile-asm:       1168 ~ 1202 ms
 // - tile-transpose: 1143 ms
 
+#include <algorithm>
+#include <array>
 #include <cfloat>
 #include <chrono>
 #include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
+#include <vector>
+#include <arm_neon.h>
+#include <sys/resource.h>
+
+#include "mm.h"
+#include "multi-thread/thread-pool.h"
+#include "perf.h"
 
 using mm_func = void(*)(const float*, const float*, float*, int, int, int);
 
@@ -23,10 +41,156 @@ extern mm_func _mm_tile_8x8;
 extern mm_func _mm_tile_8x8_T;
 extern mm_func _mm_panel_24_asm;
 extern mm_func _mm_tile_8x8_asm;
+extern mm_func _mm_ukr_8x8_asm;
+extern mm_func _mm_ukr_12x8_asm;
+extern mm_func _mm_ukr_8x12_asm;
+extern mm_func _mm_ukr_16x4_asm;
+extern mm_func _mm_ukr_4x16_asm;
+extern mm_func _mm_jit_8x8;
+extern mm_func _mm_blocked_8x8;
+extern mm_func _mm_blocked_8x8_prepacked;
+extern mm_func _mm_tuned;
+
+// fixed shape kernels, see mm_small
+using small_func = void(*)(const float*, const float*, float*);
+extern small_func _mm_small_16x16x16;
+extern small_func _mm_small_32x32x32;
+extern small_func _mm_small_48x48x48;
+extern small_func _mm_small_64x64x64;
+extern small_func _mm_small_20x36x18;
+
+struct {
+  int m, n, k;
+  small_func func;
+} small_funcs[] {
+  {16, 16, 16, _mm_small_16x16x16},
+  {32, 32, 32, _mm_small_32x32x32},
+  {48, 48, 48, _mm_small_48x48x48},
+  {64, 64, 64, _mm_small_64x64x64},
+  {20, 36, 18, _mm_small_20x36x18},
+};
+
+// fused epilogue kernels: c = act(a * b + bias) + residual, see Epilogue
+using epilogue_func = void(*)(const float*, const float*, float*, int, int,
+                              int, const float*, const float*);
+extern epilogue_func _mm_tile_8x8_T_bias_relu;
+extern epilogue_func _mm_tile_8x8_T_bias_gelu;
+extern epilogue_func _mm_tile_8x8_T_bias_residual;
+extern epilogue_func _mm_tile_8x8_asm_bias_relu;
+extern epilogue_func _mm_tile_8x8_asm_bias_gelu;
+extern epilogue_func _mm_tile_8x8_asm_bias_residual;
+
+// the same epilogues as separate elementwise passes over c
+using pass_func = void(*)(float*, int, int, const float*, const float*);
+extern pass_func _bias_pass;
+extern pass_func _relu_pass;
+extern pass_func _gelu_pass;
+extern pass_func _residual_pass;
+
+// int8 a and b, int32 sums, see mm_s8
+using s8s32_func = void(*)(const int8_t*, const int8_t*, int32_t*, int, int,
+                           int);
+using s8_func = void(*)(const int8_t*, const int8_t*, int8_t*, int, int, int,
+                        float, int);
+extern s8s32_func _mm_s8s32_tile_8x8;
+extern s8_func _mm_s8_tile_8x8_requantize;
+
+// 16 bit a and b as raw bits, fp32 c, see mm_tile_half
+using half_func = void(*)(const uint16_t*, const uint16_t*, float*, int, int,
+                          int);
+extern half_func _mm_tile_8x8_bf16;
+extern half_func _mm_tile_8x8_fp16;
+extern half_func _mm_panel_24_bf16;
+extern half_func _mm_panel_24_fp16;
 
+struct {
+  const char* name;
+  bool bf16;
+  half_func func;
+} half_funcs[] {
+  {"bf16 tile",  true,  _mm_tile_8x8_bf16},
+  {"bf16 panel", true,  _mm_panel_24_bf16},
+  {"fp16 tile",  false, _mm_tile_8x8_fp16},
+  {"fp16 panel", false, _mm_panel_24_fp16},
+};
+
+// asm kernels with software prefetch, dist: prefetch distance in k steps
+using prefetch_func = void(*)(const float*, const float*, float*, int, int,
+                              int, int);
+extern prefetch_func _mm_panel_24_pf_asm;
+extern prefetch_func _mm_tile_8x8_pf_asm;
+
+struct {
+  const char* name;
+  prefetch_func func;
+  mm_func plain;
+} prefetch_funcs[] {
+  {"panel-asm", _mm_panel_24_pf_asm, _mm_panel_24_asm},
+  {"tile-asm",  _mm_tile_8x8_pf_asm, _mm_tile_8x8_asm},
+};
+
+// double and complex float kernels, see mm_tile_wide
+template <typename T>
+using typed_func = void(*)(const T*, const T*, T*, int, int, int);
+extern typed_func<double> _mm_baseline_f64;
+extern typed_func<double> _mm_tile_8x4_f64;
+extern typed_func<double> _mm_tile_4x8_f64;
+extern typed_func<std::complex<float>> _mm_baseline_c32;
+extern typed_func<std::complex<float>> _mm_tile_4x4_c32;
+
+struct {
+  const char* name;
+  typed_func<double> func;
+} f64_funcs[] {
+  {"tile-8x4 f64", _mm_tile_8x4_f64},
+  {"tile-4x8 f64", _mm_tile_4x8_f64},
+};
+
+struct {
+  const char* name;
+  typed_func<std::complex<float>> func;
+} c32_funcs[] {
+  {"tile-4x4 c32", _mm_tile_4x4_c32},
+};
+
+enum { act_none, act_relu, act_gelu };
+
+struct {
+  const char* name;
+  int act;
+  bool residual;
+  epilogue_func fused;
+  mm_func gemm;
+} epilogue_funcs[] {
+  {"tile-transpose bias+relu",     act_relu, false,
+   _mm_tile_8x8_T_bias_relu,       _mm_tile_8x8_T  },
+  {"tile-transpose bias+gelu",     act_gelu, false,
+   _mm_tile_8x8_T_bias_gelu,       _mm_tile_8x8_T  },
+  {"tile-transpose bias+residual", act_none, true,
+   _mm_tile_8x8_T_bias_residual,   _mm_tile_8x8_T  },
+  {"tile-asm bias+relu",           act_relu, false,
+   _mm_tile_8x8_asm_bias_relu,     _mm_tile_8x8_asm},
+  {"tile-asm bias+gelu",           act_gelu, false,
+   _mm_tile_8x8_asm_bias_gelu,     _mm_tile_8x8_asm},
+  {"tile-asm bias+residual",       act_none, true,
+   _mm_tile_8x8_asm_bias_residual, _mm_tile_8x8_asm},
+};
+
+// other libraries, see mm-backends.cc
+extern mm_func _mm_llamafile;
+#ifdef MM_HAVE_BLIS
+extern mm_func _mm_blis;
+#endif
+#ifdef MM_HAVE_ONEDNN
+extern mm_func _mm_onednn;
+#endif
+
+// exact: same sum order as baseline, verified bit exact; otherwise (the
+// other libraries) within k * FLT_EPSILON relative, the data is positive
 struct {
   const char* name;
   mm_func func;
+  bool exact = true;
 } mm_funcs[] {
   {"baseline",       _mm_baseline    },
   {"panel",          _mm_panel_24    },
@@ -34,6 +198,22 @@ struct {
   {"tile",           _mm_tile_8x8    },
   {"tile-asm",       _mm_tile_8x8_asm},
   {"tile-transpose", _mm_tile_8x8_T  },
+  {"ukr-8x8-asm",    _mm_ukr_8x8_asm },
+  {"ukr-12x8-asm",   _mm_ukr_12x8_asm},
+  {"ukr-8x12-asm",   _mm_ukr_8x12_asm},
+  {"ukr-16x4-asm",   _mm_ukr_16x4_asm},
+  {"ukr-4x16-asm",   _mm_ukr_4x16_asm},
+  {"jit-8x8",        _mm_jit_8x8     },
+  {"llamafile",      _mm_llamafile,   false},
+#ifdef MM_HAVE_BLIS
+  {"blis",           _mm_blis,        false},
+#endif
+#ifdef MM_HAVE_ONEDNN
+  {"onednn",         _mm_onednn,      false},
+#endif
+  {"prepacked",      _mm_blocked_8x8_prepacked},
+  {"tuned",          _mm_tuned       },
+  {"blocked",        _mm_blocked_8x8 },
 };
 const int n_funcs = sizeof(mm_funcs) / sizeof(mm_funcs[0]);
 
@@ -43,46 +223,940 @@ void init_data(float* data, int size) {
   }
 }
 
-int main(int argc, char* argv[]) {
-  bool verify = false;
-  std::unordered_set<std::string> test_names;
-  // run last test if no specified
-  std::string test_name = argc > 1 ? argv[1] : mm_funcs[n_funcs-1].name;
-  if (test_name == "list") {
-    // list all benchmarks
-    for (const auto [name, _] : mm_funcs) {
-      std::cout << name << '\n';
+// verify sgemm strides, transposes and alpha/beta against baseline
+// - small integers keep every product and sum exact
+// - k spans more than one k block
+// - sgemm with a caller workspace and sgemm_packed with b packed once must
+//   give the same result
+int test_sgemm(int m, int n, int k) {
+  std::cout << "========== sgemm " << m << 'x' << n << 'x' << k \
+            << " ==========\n";
+  const int pad = 3;
+  const float alpha_beta[][2] = {{1, 0}, {1, 1}, {2, 0.5f}, {-1, 0}, {0, 2}};
+
+  std::vector<float> a(m*k), b(k*n), c0(m*n), t(m*n);
+  for (int i = 0; i < m*k; ++i) a[i] = static_cast<float>(i % 7 - 3);
+  for (int i = 0; i < k*n; ++i) b[i] = static_cast<float>(i % 5 - 2);
+  for (int i = 0; i < m*n; ++i) c0[i] = static_cast<float>(i % 9 - 4);
+  _mm_baseline(a.data(), b.data(), t.data(), m, n, k);
+  void* workspace = std::aligned_alloc(64, sgemm_workspace_size());
+
+  for (const bool trans_a : {false, true}) {
+    for (const bool trans_b : {false, true}) {
+      // strided sources, stored transposed if requested
+      const int lda = (trans_a ? m : k) + pad;
+      const int ldb = (trans_b ? k : n) + pad;
+      const int ldc = n + pad;
+      std::vector<float> as((trans_a ? k : m) * lda, NAN);
+      std::vector<float> bs((trans_b ? n : k) * ldb, NAN);
+      for (int i = 0; i < m; ++i) {
+        for (int p = 0; p < k; ++p) {
+          (trans_a ? as[p*lda + i] : as[i*lda + p]) = a[i*k + p];
+        }
+      }
+      for (int p = 0; p < k; ++p) {
+        for (int j = 0; j < n; ++j) {
+          (trans_b ? bs[j*ldb + p] : bs[p*ldb + j]) = b[p*n + j];
+        }
+      }
+
+      for (const auto [alpha, beta] : alpha_beta) {
+        // 0: sgemm, 1: sgemm with own workspace, 2: sgemm_packed
+        for (const int mode : {0, 1, 2}) {
+          // pad columns of c must be left untouched
+          std::vector<float> cs(m * ldc, -1);
+          for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < n; ++j) {
+              cs[i*ldc + j] = c0[i*n + j];
+            }
+          }
+          if (mode == 0) {
+            sgemm(trans_a, trans_b, m, n, k, alpha, as.data(), lda,
+                  bs.data(), ldb, beta, cs.data(), ldc);
+          } else if (mode == 1) {
+            sgemm(trans_a, trans_b, m, n, k, alpha, as.data(), lda,
+                  bs.data(), ldb, beta, cs.data(), ldc, workspace);
+          } else {
+            sgemm_packed(trans_a, m, alpha, as.data(), lda,
+                         sgemm_pack_b(trans_b, k, n, bs.data(), ldb),
+                         beta, cs.data(), ldc);
+          }
+          for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < ldc; ++j) {
+              const float expect =
+                  j < n ? alpha * t[i*n + j] + beta * c0[i*n + j] : -1;
+              if (cs[i*ldc + j] != expect) {
+                std::cerr << "FAILED! mode=" << mode << ", trans_a=" \
+                          << trans_a << ", trans_b=" << trans_b \
+                          << ", alpha=" << alpha << ", beta=" << beta \
+                          << " [" << i << "][" << j << "]: expect " \
+                          << expect << ", get " << cs[i*ldc + j] << '\n';
+                std::free(workspace);
+                return 1;
+              }
+            }
+          }
+        }
+      }
+      // bs is freed, its pack must not be found by a later allocation
+      sgemm_unpack_b(bs.data());
     }
-    return 0;
-  } else if (test_name == "all" || test_name == "test") {
-    // run all benchmarks
-    for (const auto [name, _] : mm_funcs) {
-      test_names.insert(name);
+  }
+  std::free(workspace);
+  std::cout << "OK\n";
+  return 0;
+}
+
+// general shape, and m == 1 / n == 1 of the matrix vector fast paths
+int test_sgemm() {
+  return test_sgemm(37, 29, 300) || test_sgemm(1, 29, 300) ||
+         test_sgemm(37, 1, 300);
+}
+
+// verify fixed shape kernels against baseline
+int test_small() {
+  std::cout << "========== small ==========\n";
+  for (const auto [m, n, k, func] : small_funcs) {
+    std::vector<float> a(m*k), b(k*n), c(m*n), t(m*n);
+    init_data(a.data(), m*k);
+    init_data(b.data(), k*n);
+    _mm_baseline(a.data(), b.data(), t.data(), m, n, k);
+    func(a.data(), b.data(), c.data());
+    for (int i = 0; i < m*n; ++i) {
+      if (std::fabs(c[i] - t[i]) > FLT_MIN) {
+        std::cerr << "FAILED! " << m << 'x' << n << 'x' << k << " [" << i \
+                  << "]: expect " << t[i] << ", get " << c[i] << '\n';
+        return 1;
+      }
     }
-    // verify test results
-    verify = test_name == "test";
-  } else {
-    // run specific benchmark
-    for (const auto [name, _] : mm_funcs) {
-      if (test_name == name) {
-        test_names.insert(name);
-        break;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// best of several runs in seconds
+template <typename F>
+double best_seconds(int runs, F&& f) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    f();
+    const auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best,
+                    std::chrono::duration<double>(end - start).count());
+  }
+  return best;
+}
+
+// verify fused epilogues against baseline plus a scalar epilogue
+// - bias, relu and residual are exact, gelu within 1e-5 relative to tanh
+int test_epilogue() {
+  std::cout << "========== epilogue ==========\n";
+  const int shapes[][3] = {{37, 29, 61}, {64, 64, 64}, {5, 7, 3}};
+  for (const auto [m, n, k] : shapes) {
+    std::vector<float> a(m*k), b(k*n), c(m*n), t(m*n), bias(n), res(m*n);
+    for (int i = 0; i < m*k; ++i) a[i] = (i % 7 - 3) * 0.125f;
+    for (int i = 0; i < k*n; ++i) b[i] = (i % 5 - 2) * 0.125f;
+    for (int i = 0; i < n; ++i) bias[i] = (i % 11 - 5) * 0.25f;
+    for (int i = 0; i < m*n; ++i) res[i] = (i % 13 - 6) * 0.5f;
+    _mm_baseline(a.data(), b.data(), t.data(), m, n, k);
+
+    for (const auto& [name, act, residual, fused, _] : epilogue_funcs) {
+      fused(a.data(), b.data(), c.data(), m, n, k, bias.data(), res.data());
+      for (int i = 0; i < m*n; ++i) {
+        float expect = t[i] + bias[i % n];
+        if (act == act_relu) expect = std::max(expect, 0.f);
+        if (act == act_gelu) {
+          const double x = expect;
+          expect = 0.5 * x * (1 + std::tanh(0.7978845608028654 *
+                                            (x + 0.044715 * x * x * x)));
+        }
+        if (residual) expect += res[i];
+        const float tolerance =
+            act == act_gelu ? 1e-5f * std::max(1.f, std::fabs(expect))
+                            : FLT_MIN;
+        if (std::fabs(c[i] - expect) > tolerance) {
+          std::cerr << "FAILED! " << name << ' ' << m << 'x' << n << 'x' \
+                    << k << " [" << i << "]: expect " << expect \
+                    << ", get " << c[i] << '\n';
+          return 1;
+        }
       }
     }
-    if (test_names.empty()) {
-      std::cerr << "unknown benchmark: " << test_name << '\n';
-      std::cerr << "supported options: \n";
-      std::cerr << "- list:   list all benchmark name\n";
-      std::cerr << "- all:    run all benchmarks\n";
-      std::cerr << "- test:   verify all benchmarks\n";
-      std::cerr << "- [name]: specify valid benchmark name\n";
-      return 1;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// fused epilogues against gemm plus separate elementwise passes
+// - passes run over the c of the whole batch, as a model runs them over a
+//   layer's output; each reads and writes all of c again
+int bench_epilogue(int batch, int m, int n, int k) {
+  if (test_epilogue()) return 1;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(batch * static_cast<long>(m) * k);
+  std::vector<float> b(batch * static_cast<long>(k) * n);
+  std::vector<float> c(batch * mn), res(batch * mn), bias(n);
+  init_data(a.data(), a.size());
+  init_data(b.data(), b.size());
+  for (long i = 0; i < batch * mn; ++i) res[i] = (i % 13 - 6) * 0.5f;
+  for (int i = 0; i < n; ++i) bias[i] = (i % 11 - 5) * 0.25f;
+
+  // best of 3 after a warmup run
+  auto time_ms = [](auto&& run) {
+    run();
+    return best_seconds(3, run) * 1e3;
+  };
+  std::cout << "---------- " << batch << " x " << m << 'x' << n << 'x' << k \
+            << " ----------\n";
+  for (const auto& e : epilogue_funcs) {
+    const double fused_ms = time_ms([&] {
+      for (long i = 0; i < batch; ++i) {
+        e.fused(&a[i*m*k], &b[i*k*n], &c[i*mn], m, n, k, bias.data(),
+                &res[i*mn]);
+      }
+    });
+    const double separate_ms = time_ms([&] {
+      for (long i = 0; i < batch; ++i) {
+        e.gemm(&a[i*m*k], &b[i*k*n], &c[i*mn], m, n, k);
+      }
+      float* c_all = c.data();
+      _bias_pass(c_all, batch * m, n, bias.data(), nullptr);
+      if (e.act == act_relu) _relu_pass(c_all, batch * m, n, nullptr, nullptr);
+      if (e.act == act_gelu) _gelu_pass(c_all, batch * m, n, nullptr, nullptr);
+      if (e.residual) _residual_pass(c_all, batch * m, n, nullptr, res.data());
+    });
+    std::cout << e.name << ": fused " << fused_ms << " ms, separate " \
+              << separate_ms << " ms, " << separate_ms / fused_ms \
+              << "x\n";
+  }
+  return 0;
+}
+
+// verify mm_batched against baseline per matrix
+// - b per matrix, broadcast b (stacked and with gaps), broadcast a
+int test_batched() {
+  std::cout << "========== batched ==========\n";
+  const int shapes[][4] = {{7, 5, 12, 9}, {3, 37, 29, 300}, {5, 1, 70, 80}};
+  for (const auto [batch, m, n, k] : shapes) {
+    const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+    const long mn = static_cast<long>(m) * n, gap = 5;
+    std::vector<float> a(batch * (mk + gap)), b(batch * (kn + gap));
+    std::vector<float> c(batch * (mn + gap)), t(mn);
+    init_data(a.data(), a.size());
+    for (size_t i = 0; i < b.size(); ++i) b[i] = static_cast<float>(i % 9);
+    const struct {
+      const char* name;
+      long stride_a, stride_b, stride_c;
+    } modes[] = {
+      {"separate",           mk,       kn, mn      },
+      {"broadcast b",        mk,        0, mn      },
+      {"broadcast b, gaps",  mk + gap,  0, mn + gap},
+      {"broadcast a",         0, kn + gap, mn      },
+    };
+    for (const auto [name, stride_a, stride_b, stride_c] : modes) {
+      std::fill(c.begin(), c.end(), -1.f);
+      mm_batched(batch, m, n, k, a.data(), stride_a, b.data(), stride_b,
+                 c.data(), stride_c);
+      for (long i = 0; i < batch; ++i) {
+        _mm_baseline(&a[i * stride_a], &b[i * stride_b], t.data(), m, n, k);
+        for (long j = 0; j < mn; ++j) {
+          if (std::fabs(c[i * stride_c + j] - t[j]) > FLT_MIN) {
+            std::cerr << "FAILED! " << name << ' ' << batch << " x " << m \
+                      << 'x' << n << 'x' << k << " [" << i << "][" << j \
+                      << "]: expect " << t[j] << ", get " \
+                      << c[i * stride_c + j] << '\n';
+            return 1;
+          }
+        }
+      }
     }
   }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// mm_batched against a loop of blocked calls, b per matrix and broadcast b
+int bench_batched(int batch, int m, int n, int k) {
+  if (test_batched()) return 1;
+  const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(batch * mk), b(batch * kn), c(batch * mn);
+  init_data(a.data(), a.size());
+  init_data(b.data(), b.size());
+
+  // best of 3 after a warmup run
+  auto time_ms = [](auto&& run) {
+    run();
+    return best_seconds(3, run) * 1e3;
+  };
+  std::cout << "---------- " << batch << " x " << m << 'x' << n << 'x' << k \
+            << " ----------\n";
+  for (const long stride_b : {kn, 0L}) {
+    const double loop_ms = time_ms([&] {
+      for (long i = 0; i < batch; ++i) {
+        _mm_blocked_8x8(&a[i * mk], &b[i * stride_b], &c[i * mn], m, n, k);
+      }
+    });
+    const double batched_ms = time_ms([&] {
+      mm_batched(batch, m, n, k, a.data(), mk, b.data(), stride_b, c.data(),
+                 mn);
+    });
+    std::cout << (stride_b ? "b per matrix" : "broadcast b") << ": loop " \
+              << loop_ms << " ms, batched " << batched_ms << " ms, " \
+              << loop_ms / batched_ms << "x\n";
+  }
+  return 0;
+}
+
+// int8 data over the whole range -128 ~ 127, in a pattern of period 251
+void init_data_s8(int8_t* data, long size) {
+  for (long i = 0; i < size; ++i) {
+    data[i] = static_cast<int8_t>(i * 97 % 251 - 125);
+  }
+}
+
+// verify the int8 kernels against baseline on the same values as float
+// - sums stay below 2^24, so baseline is exact and int32 must match it
+// - requantized: the same rounding and saturation on the baseline sums,
+//   the scales are chosen so that some elements saturate
+int test_int8() {
+  std::cout << "========== int8 ==========\n";
+  const int shapes[][3] = {{37, 29, 300}, {8, 8, 2}, {1, 13, 7}, {64, 64, 255}};
+  for (const auto [m, n, k] : shapes) {
+    std::vector<int8_t> a(m * k), b(k * n), c(m * n);
+    std::vector<int32_t> c32(m * n);
+    init_data_s8(a.data(), a.size());
+    init_data_s8(b.data(), b.size());
+    std::vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end());
+    std::vector<float> t(m * n);
+    _mm_baseline(af.data(), bf.data(), t.data(), m, n, k);
+
+    _mm_s8s32_tile_8x8(a.data(), b.data(), c32.data(), m, n, k);
+    for (int i = 0; i < m * n; ++i) {
+      if (c32[i] != t[i]) {
+        std::cerr << "FAILED! int32 " << m << 'x' << n << 'x' << k << " [" \
+                  << i << "]: expect " << t[i] << ", get " << c32[i] << '\n';
+        return 1;
+      }
+    }
+    for (const auto [scale, zero_point] : {std::pair{1.f / 64, 0},
+                                           std::pair{1.f / 3000, -7}}) {
+      _mm_s8_tile_8x8_requantize(a.data(), b.data(), c.data(), m, n, k,
+                                 scale, zero_point);
+      for (int i = 0; i < m * n; ++i) {
+        const float q = std::nearbyint(t[i] * scale) + zero_point;
+        const int expect = static_cast<int>(std::clamp(q, -128.f, 127.f));
+        if (c[i] != expect) {
+          std::cerr << "FAILED! int8 " << m << 'x' << n << 'x' << k \
+                    << " scale " << scale << " [" << i << "]: expect " \
+                    << expect << ", get " << int{c[i]} << '\n';
+          return 1;
+        }
+      }
+    }
+  }
+  std::cout << "OK\n";
+  return 0;
+}
 
-  const int batch = 512;
-  const int m = 1000, n = 240, k = 200;
+// int8 kernels against the fp32 tile kernel of the same register tile
+// - ops: 2 per multiply-add; bytes: a and b as read from memory
+int bench_int8(int m, int n, int k) {
+  if (test_int8()) return 1;
+  const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(mk), b(kn), c(mn);
+  std::vector<int8_t> a8(mk), b8(kn), c8(mn);
+  std::vector<int32_t> c32(mn);
+  init_data(a.data(), a.size());
+  init_data(b.data(), b.size());
+  init_data_s8(a8.data(), a8.size());
+  init_data_s8(b8.data(), b8.size());
 
+  std::cout << "---------- " << m << 'x' << n << 'x' << k << " ----------\n";
+  auto report = [&](const char* name, int bytes, auto&& run) {
+    run();
+    const double seconds = best_seconds(3, run);
+    std::cout << name << ": " << seconds * 1e3 << " ms, " \
+              << 2.0 * mn * k / seconds / 1e9 << " gops, a + b " \
+              << (mk + kn) * bytes / 1024 << " KB\n";
+  };
+  report("fp32 tile", 4, [&] {
+    _mm_tile_8x8(a.data(), b.data(), c.data(), m, n, k);
+  });
+  report("int8 -> int32", 1, [&] {
+    _mm_s8s32_tile_8x8(a8.data(), b8.data(), c32.data(), m, n, k);
+  });
+  report("int8 -> int8 requantized", 1, [&] {
+    _mm_s8_tile_8x8_requantize(a8.data(), b8.data(), c8.data(), m, n, k,
+                               1.f / 1024, 0);
+  });
+  return 0;
+}
+
+// float to bf16 bits, round to nearest even, no nan in the data
+uint16_t to_bf16(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+// float to fp16 bits, round to nearest even
+uint16_t to_fp16(float f) {
+  const __fp16 h = f;
+  uint16_t bits;
+  std::memcpy(&bits, &h, sizeof(bits));
+  return bits;
+}
+
+float half_to_float(uint16_t h, bool bf16) {
+  if (bf16) {
+    const uint32_t bits = static_cast<uint32_t>(h) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  __fp16 f;
+  std::memcpy(&f, &h, sizeof(f));
+  return f;
+}
+
+std::vector<uint16_t> to_half(const std::vector<float>& x, bool bf16) {
+  std::vector<uint16_t> h(x.size());
+  for (size_t i = 0; i < x.size(); ++i) {
+    h[i] = bf16 ? to_bf16(x[i]) : to_fp16(x[i]);
+  }
+  return h;
+}
+
+// verify 16 bit kernels against baseline of the unrounded fp32 data
+// - a and b are rounded once, relative error u each: 2^-8 bf16, 2^-11 fp16
+// - error of c[i][j] is bounded by (2u + k * FLT_EPSILON) * sum |a| * |b|,
+//   the fp32 sums of both the kernel and baseline included
+int test_half() {
+  std::cout << "========== half ==========\n";
+  const int shapes[][3] = {{37, 29, 300}, {8, 8, 4}, {1, 70, 81}, {5, 1, 13}};
+  for (const auto [m, n, k] : shapes) {
+    std::vector<float> a(m*k), b(k*n), c(m*n), t(m*n), t_abs(m*n);
+    for (int i = 0; i < m*k; ++i) a[i] = (i % 13 - 6) / 7.f;
+    for (int i = 0; i < k*n; ++i) b[i] = (i % 11 - 5) / 3.f;
+    _mm_baseline(a.data(), b.data(), t.data(), m, n, k);
+    std::vector<float> a_abs(m*k), b_abs(k*n);
+    for (int i = 0; i < m*k; ++i) a_abs[i] = std::fabs(a[i]);
+    for (int i = 0; i < k*n; ++i) b_abs[i] = std::fabs(b[i]);
+    _mm_baseline(a_abs.data(), b_abs.data(), t_abs.data(), m, n, k);
+
+    for (const auto [name, bf16, func] : half_funcs) {
+      const auto a16 = to_half(a, bf16), b16 = to_half(b, bf16);
+      func(a16.data(), b16.data(), c.data(), m, n, k);
+      const float u = bf16 ? 1.f / 256 : 1.f / 2048;
+      for (int i = 0; i < m*n; ++i) {
+        const float tolerance = (2 * u + k * FLT_EPSILON) * t_abs[i];
+        if (std::fabs(c[i] - t[i]) > tolerance) {
+          std::cerr << "FAILED! " << name << ' ' << m << 'x' << n << 'x' \
+                    << k << " [" << i << "]: expect " << t[i] << " +- " \
+                    << tolerance << ", get " << c[i] << '\n';
+          return 1;
+        }
+      }
+    }
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// 16 bit kernels against fp32 ones, and against upconverting a and b to
+// fp32 before each gemm
+// - bytes: a, b and c as read and written once, GB/s is bytes / time
+int bench_half(int m, int n, int k) {
+  const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(mk), b(kn), c(mn), a32(mk), b32(kn);
+  for (long i = 0; i < mk; ++i) a[i] = (i % 13 - 6) / 7.f;
+  for (long i = 0; i < kn; ++i) b[i] = (i % 11 - 5) / 3.f;
+  const double bytes_32 = (mk + kn + mn) * 4.0;
+  const double bytes_16 = (mk + kn) * 2.0 + mn * 4.0;
+
+  std::cout << "---------- " << m << 'x' << n << 'x' << k << " ----------\n";
+  std::cout << "a + b: fp32 " << (mk + kn) * 4 / 1024 << " KB, 16 bit " \
+            << (mk + kn) * 2 / 1024 << " KB; a + b + c: " \
+            << 100 * (1 - bytes_16 / bytes_32) << "% less\n";
+  auto report = [&](const std::string& name, double bytes, auto&& run) {
+    run();
+    const double seconds = best_seconds(5, run);
+    std::cout << name << ": " << seconds * 1e3 << " ms, " \
+              << bytes / seconds / 1e9 << " GB/s";
+    return seconds;
+  };
+  const double fp32 = report("fp32 blocked", bytes_32, [&] {
+    _mm_blocked_8x8(a.data(), b.data(), c.data(), m, n, k);
+  });
+  std::cout << '\n';
+  for (const bool bf16 : {true, false}) {
+    const auto a16 = to_half(a, bf16), b16 = to_half(b, bf16);
+    const char* format = bf16 ? "bf16" : "fp16";
+    const double upconvert = report(format + std::string(" upconvert"),
+                                    bytes_16, [&] {
+      for (long i = 0; i < mk; ++i) a32[i] = half_to_float(a16[i], bf16);
+      for (long i = 0; i < kn; ++i) b32[i] = half_to_float(b16[i], bf16);
+      _mm_blocked_8x8(a32.data(), b32.data(), c.data(), m, n, k);
+    });
+    std::cout << ", " << fp32 / upconvert << "x of fp32\n";
+    for (const auto [name, func_bf16, func] : half_funcs) {
+      if (func_bf16 != bf16) continue;
+      const double seconds = report(name, bytes_16, [&] {
+        func(a16.data(), b16.data(), c.data(), m, n, k);
+      });
+      std::cout << ", " << fp32 / seconds << "x of fp32, " \
+                << upconvert / seconds << "x of upconvert\n";
+    }
+  }
+  return 0;
+}
+
+// small integers, imaginary parts too, keep every product and sum exact
+template <typename T>
+void init_data_small(std::vector<T>& data, int period) {
+  for (size_t i = 0; i < data.size(); ++i) {
+    const float re = static_cast<float>(i % period) - period / 2;
+    if constexpr (std::is_same_v<T, double>) {
+      data[i] = re;
+    } else {
+      data[i] = T(re, static_cast<float>(i % 3) - 1);
+    }
+  }
+}
+
+// verify double or complex float kernels against their baseline
+template <typename T, typename Funcs>
+int test_typed(const char* type, typed_func<T> baseline, const Funcs& funcs) {
+  std::cout << "========== " << type << " ==========\n";
+  const int shapes[][3] = {{37, 29, 61}, {8, 4, 2}, {5, 7, 3}, {1, 13, 1}};
+  for (const auto [m, n, k] : shapes) {
+    std::vector<T> a(m*k), b(k*n), c(m*n), t(m*n);
+    init_data_small(a, 7);
+    init_data_small(b, 5);
+    baseline(a.data(), b.data(), t.data(), m, n, k);
+    for (const auto [name, func] : funcs) {
+      func(a.data(), b.data(), c.data(), m, n, k);
+      for (int i = 0; i < m*n; ++i) {
+        if (c[i] != t[i]) {
+          std::cerr << "FAILED! " << name << ' ' << m << 'x' << n << 'x' \
+                    << k << " [" << i << "]: expect " << t[i] << ", get " \
+                    << c[i] << '\n';
+          return 1;
+        }
+      }
+    }
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+int test_f64() { return test_typed("f64", _mm_baseline_f64, f64_funcs); }
+int test_c32() { return test_typed("c32", _mm_baseline_c32, c32_funcs); }
+
+// double or complex float kernels against their baseline
+// - flops: 2 per real multiply-add, 8 per complex one
+template <typename T, typename Funcs>
+int bench_typed(typed_func<T> baseline, const Funcs& funcs, int m, int n,
+                int k) {
+  const long mn = static_cast<long>(m) * n;
+  std::vector<T> a(static_cast<long>(m) * k), b(static_cast<long>(k) * n);
+  std::vector<T> c(mn);
+  init_data_small(a, 7);
+  init_data_small(b, 5);
+  const double flops = (std::is_same_v<T, double> ? 2.0 : 8.0) * mn * k;
+
+  std::cout << "---------- " << m << 'x' << n << 'x' << k << " ----------\n";
+  auto report = [&](const char* name, typed_func<T> func) {
+    auto run = [&] { func(a.data(), b.data(), c.data(), m, n, k); };
+    run();
+    const double seconds = best_seconds(3, run);
+    std::cout << name << ": " << seconds * 1e3 << " ms, " \
+              << flops / seconds / 1e9 << " gflops\n";
+  };
+  report("baseline", baseline);
+  for (const auto [name, func] : funcs) report(name, func);
+  return 0;
+}
+
+// verify mm_grouped against baseline per problem, inline and on a pool of 3
+// threads
+int test_grouped() {
+  std::cout << "========== grouped ==========\n";
+  const int shapes[][3] = {
+    {1, 70, 80}, {37, 29, 300}, {300, 600, 50}, {5, 1, 13}, {130, 257, 7},
+  };
+  const int count = sizeof(shapes) / sizeof(shapes[0]);
+  std::vector<std::vector<float>> a(count), b(count), c(count), t(count);
+  std::vector<mm_problem> problems;
+  for (int i = 0; i < count; ++i) {
+    const auto [m, n, k] = shapes[i];
+    a[i].resize(m * k);
+    b[i].resize(k * n);
+    t[i].resize(m * n);
+    init_data(a[i].data(), m * k);
+    init_data(b[i].data(), k * n);
+    _mm_baseline(a[i].data(), b[i].data(), t[i].data(), m, n, k);
+    problems.push_back({m, n, k, a[i].data(), b[i].data(), nullptr});
+  }
+  ThreadPool pool(3);
+  for (const int threads : {1, 3}) {
+    for (int i = 0; i < count; ++i) {
+      c[i].assign(t[i].size(), -1.f);
+      problems[i].c = c[i].data();
+    }
+    mm_grouped(count, problems.data(), threads > 1 ? &pool : nullptr);
+    for (int i = 0; i < count; ++i) {
+      for (size_t j = 0; j < t[i].size(); ++j) {
+        if (std::fabs(c[i][j] - t[i][j]) > FLT_MIN) {
+          std::cerr << "FAILED! threads=" << threads << ", problem " << i \
+                    << " [" << j << "]: expect " << t[i][j] << ", get " \
+                    << c[i][j] << '\n';
+          return 1;
+        }
+      }
+    }
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// mm_grouped against a loop of blocked calls, moe like problems: the same
+// n and k, m of 1 ~ m_max (tokens per expert)
+int bench_grouped(int count, int m_max, int n, int k) {
+  if (test_grouped()) return 1;
+  std::vector<std::vector<float>> a(count), b(count), c(count);
+  std::vector<mm_problem> problems;
+  long flops = 0;
+  for (int i = 0; i < count; ++i) {
+    const int m = 1 + i * 37 % m_max;
+    a[i].resize(static_cast<long>(m) * k);
+    b[i].resize(static_cast<long>(k) * n);
+    c[i].resize(static_cast<long>(m) * n);
+    init_data(a[i].data(), a[i].size());
+    init_data(b[i].data(), b[i].size());
+    problems.push_back({m, n, k, a[i].data(), b[i].data(), c[i].data()});
+    flops += 2L * m * n * k;
+  }
+
+  std::cout << "---------- " << count << " problems, m 1 ~ " << m_max \
+            << ", n " << n << ", k " << k << " ----------\n";
+  auto report = [&](const std::string& name, auto&& run) {
+    run();
+    const double seconds = best_seconds(3, run);
+    std::cout << name << ": " << seconds * 1e3 << " ms, " \
+              << flops / seconds / 1e9 << " gflops\n";
+  };
+  report("loop", [&] {
+    for (const auto& p : problems) {
+      _mm_blocked_8x8(p.a, p.b, p.c, p.m, p.n, p.k);
+    }
+  });
+  report("grouped", [&] { mm_grouped(count, problems.data()); });
+  // workers are created and pinned once, outside the timed runs
+  const int threads = std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool pool(threads);
+  report("grouped, " + std::to_string(threads) + " threads",
+         [&] { mm_grouped(count, problems.data(), &pool); });
+  return 0;
+}
+
+// ns per call of the fixed shape kernels against the general ones
+// - the same a, b and c for all calls, everything stays in L1
+// - 2^32 multiply-adds per kernel and shape, 1M calls for 16x16x16
+int bench_small() {
+  if (test_small()) return 1;
+  const struct {
+    const char* name;
+    mm_func func;
+  } general[] = {
+    {"tile-asm",       _mm_tile_8x8_asm},
+    {"tile-transpose", _mm_tile_8x8_T  },
+    {"blocked",        _mm_blocked_8x8 },
+  };
+  for (const auto [m, n, k, func] : small_funcs) {
+    std::vector<float> a(m*k), b(k*n), c(m*n);
+    init_data(a.data(), m*k);
+    init_data(b.data(), k*n);
+    const long calls = (1L << 32) / (static_cast<long>(m) * n * k);
+    auto time_ns = [&](auto&& call) {
+      call();
+      const auto start = std::chrono::high_resolution_clock::now();
+      for (long i = 0; i < calls; ++i) call();
+      const auto end = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<double, std::nano>(end - start).count() \
+             / calls;
+    };
+
+    std::cout << "---------- " << m << 'x' << n << 'x' << k << ", " \
+              << calls << " calls ----------\n";
+    const double small_ns =
+        time_ns([&] { func(a.data(), b.data(), c.data()); });
+    std::cout << "small: " << small_ns << " ns/call\n";
+    for (const auto [name, general_func] : general) {
+      const double ns = time_ns([&] {
+        general_func(a.data(), b.data(), c.data(), m, n, k);
+      });
+      std::cout << name << ": " << ns << " ns/call, " << ns / small_ns \
+                << "x of small\n";
+    }
+  }
+  return 0;
+}
+
+// per core peak of fmla in gflops, 8 flops per fmla of 4 floats
+// - 16 independent accumulators cover the fma latency (4 cycles) of up to 4
+//   fma pipes, no loads in the loop
+double peak_gflops() {
+  volatile float x_in = 1.0000001f, y_in = 0.9999999f;
+  const float32x4_t x = vdupq_n_f32(x_in), y = vdupq_n_f32(y_in);
+  const long iters = 1L << 24;
+  volatile float sink;
+  const double seconds = best_seconds(3, [&] {
+    float32x4_t acc[16];
+    for (auto& v : acc) v = vdupq_n_f32(0.f);
+    for (long i = 0; i < iters; ++i) {
+      for (auto& v : acc) v = vfmaq_f32(v, x, y);
+    }
+    for (int i = 1; i < 16; ++i) acc[0] = vaddq_f32(acc[0], acc[i]);
+    sink = vaddvq_f32(acc[0]);
+  });
+  (void)sink;
+  return iters * 16 * 8.0 / seconds / 1e9;
+}
+
+// read bandwidth of a buffer of bytes read over and over, in GB/s
+// - 1G bytes per run, 64 bytes per step into 4 independent sums
+double read_gbps(long bytes) {
+  const long size = bytes / sizeof(float) / 16 * 16;
+  std::vector<float> data(size, 1.f);
+  const long passes = std::max(1L, (1L << 30) / bytes);
+  volatile float sink;
+  const double seconds = best_seconds(3, [&] {
+    float32x4_t acc[4];
+    for (auto& v : acc) v = vdupq_n_f32(0.f);
+    for (long p = 0; p < passes; ++p) {
+      for (long i = 0; i < size; i += 16) {
+        for (int j = 0; j < 4; ++j) {
+          acc[j] = vaddq_f32(acc[j], vld1q_f32(&data[i + j * 4]));
+        }
+      }
+    }
+    sink = vaddvq_f32(vaddq_f32(vaddq_f32(acc[0], acc[1]),
+                                vaddq_f32(acc[2], acc[3])));
+  });
+  (void)sink;
+  return passes * size * sizeof(float) / seconds / 1e9;
+}
+
+// roofline of one core: fmla peak and read bandwidth of each memory level
+// - working sets: 16K (L1), 256K (L2), 256M (dram)
+struct Machine {
+  double peak_gflops, l1_gbps, l2_gbps, dram_gbps;
+
+  static Machine probe() {
+    Machine machine{::peak_gflops(), read_gbps(16 << 10), read_gbps(256 << 10),
+                    read_gbps(256L << 20)};
+    std::cout << "peak: " << machine.peak_gflops << " gflops, read " \
+              << "bandwidth: L1 " << machine.l1_gbps << " GB/s, L2 " \
+              << machine.l2_gbps << " GB/s, dram " << machine.dram_gbps \
+              << " GB/s\n";
+    std::cout << "ridge point: " \
+              << machine.peak_gflops / machine.dram_gbps \
+              << " flop/byte (dram)\n";
+    return machine;
+  }
+
+  // attainable gflops at arithmetic intensity ai (flop/byte) from dram
+  double roof(double ai) const {
+    return std::min(peak_gflops, ai * dram_gbps);
+  }
+};
+
+// stream like triad bandwidth probe, a = b + s * c, in GB/s
+// - 3 * 128M bytes, far beyond the last level cache
+// - bytes counted as in stream: 2 reads and 1 write per element
+double stream_triad_gbps() {
+  const long size = 1L << 25;
+  std::vector<float> a(size), b(size, 1.f), c(size, 2.f);
+  const float s = 3.f;
+  const double seconds = best_seconds(5, [&] {
+    for (long i = 0; i < size; ++i) a[i] = b[i] + s * c[i];
+  });
+  return 3.0 * size * sizeof(float) / seconds / 1e9;
+}
+
+// bandwidth of the matrix vector fast paths against the triad probe
+// - y = x * b (m == 1) and y = a * x (n == 1), the matrix is k * n
+// - bytes: matrix + vectors, read once per call
+int bench_gemv(int n, int k) {
+  const struct {
+    const char* name;
+    mm_func func;
+  } funcs[] = {
+    {"blocked",        _mm_blocked_8x8},
+    {"tile-transpose", _mm_tile_8x8_T },
+  };
+  const double triad = stream_triad_gbps();
+  std::cout << "stream triad: " << triad << " GB/s\n";
+
+  std::vector<float> mat(static_cast<long>(k) * n), x(k), y(n);
+  init_data(x.data(), k);
+  for (long i = 0; i < static_cast<long>(k) * n; ++i) {
+    mat[i] = static_cast<float>(i % 7 - 3);
+  }
+  const double bytes = (static_cast<double>(k) * n + k + n) * sizeof(float);
+  for (const bool row_vector : {true, false}) {
+    std::cout << "---------- " << (row_vector ? "1" : std::to_string(n)) \
+              << 'x' << (row_vector ? std::to_string(n) : "1") << 'x' \
+              << k << " ----------\n";
+    for (const auto [name, func] : funcs) {
+      const double seconds = best_seconds(10, [&] {
+        if (row_vector) {
+          func(x.data(), mat.data(), y.data(), 1, n, k);
+        } else {
+          func(mat.data(), x.data(), y.data(), n, 1, k);
+        }
+      });
+      const double gbps = bytes / seconds / 1e9;
+      std::cout << name << ": " << seconds * 1e3 << " ms, " << gbps \
+                << " GB/s, " << 100 * gbps / triad << "% of triad\n";
+    }
+  }
+  return 0;
+}
+
+// minor and major page faults of the process so far
+long page_faults() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+// counters of one timed region doing flops floating point operations
+// - ipc, refills per 1000 flops
+// - fma utilization: fmla of 4 floats (8 flops) issued per cycle against
+//   the fma pipes of the core, env MM_FMA_PIPES, default 2 (neoverse n1)
+void print_counters(const PerfCounters& counters, double flops) {
+  if (!counters.available()) return;
+  for (int i = 0; i < PerfCounters::n_events; ++i) {
+    std::cout << PerfCounters::name(i) << ": ";
+    if (counters[i] < 0) {
+      std::cout << "not counted\n";
+    } else {
+      std::cout << static_cast<long>(counters[i]) << '\n';
+    }
+  }
+  const double cycles = counters[PerfCounters::cycles];
+  if (cycles <= 0) return;
+  const double instructions = counters[PerfCounters::instructions];
+  if (instructions >= 0) std::cout << "IPC: " << instructions / cycles << '\n';
+  for (const int refill :
+       {PerfCounters::l1d_refill, PerfCounters::l2d_refill}) {
+    if (counters[refill] >= 0) {
+      std::cout << PerfCounters::name(refill) << " per kflop: " \
+                << counters[refill] / flops * 1e3 << '\n';
+    }
+  }
+  const char* pipes_env = std::getenv("MM_FMA_PIPES");
+  const int pipes = pipes_env ? std::max(1, std::atoi(pipes_env)) : 2;
+  std::cout << "FMA utilization: " \
+            << 100 * flops / 8 / (cycles * pipes) << "%\n";
+}
+
+// prefetch only moves data early, so the result must match the kernel
+// without prefetch exactly, also with the distance past the end of a and b
+int test_prefetch() {
+  std::cout << "========== prefetch ==========\n";
+  const int shapes[][3] = {{37, 29, 61}, {64, 48, 300}, {8, 24, 5}, {5, 7, 3}};
+  for (const auto [m, n, k] : shapes) {
+    std::vector<float> a(m*k), b(k*n), c(m*n), t(m*n);
+    init_data(a.data(), m*k);
+    init_data(b.data(), k*n);
+    for (const auto& f : prefetch_funcs) {
+      f.plain(a.data(), b.data(), t.data(), m, n, k);
+      for (const int dist : {1, 16, 1024}) {
+        f.func(a.data(), b.data(), c.data(), m, n, k, dist);
+        if (c != t) {
+          std::cerr << "FAILED! " << f.name << " dist " << dist << ' ' \
+                    << m << 'x' << n << 'x' << k << '\n';
+          return 1;
+        }
+      }
+    }
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// prefetch distance sweep of the asm kernels, time and cache refills
+// - dist 0 is the kernel without prefetch
+// - refills per 1000 flops, counted over all timed runs
+int bench_prefetch(int batch, int m, int n, int k) {
+  if (test_prefetch()) return 1;
+  const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(batch * mk), b(batch * kn), c(batch * mn);
+  init_data(a.data(), a.size());
+  init_data(b.data(), b.size());
+
+  static PerfCounters counters;
+  if (!counters.available()) {
+    std::cout << "perf counters unavailable: " << counters.error() << '\n';
+  }
+  const int runs = 3;
+  const double flops = 2.0 * batch * mn * k;
+  std::cout << "========== " << batch << " x " << m << 'x' << n << 'x' \
+            << k << " ==========\n";
+  std::cout << "kernel      dist   time (ms)   gflops" \
+            << "   L1D/kflop   L2D/kflop\n";
+  for (const auto& f : prefetch_funcs) {
+    for (const int dist : {0, 4, 8, 16, 32, 64, 128, 256}) {
+      auto run = [&] {
+        for (long i = 0; i < batch; ++i) {
+          if (dist == 0) {
+            f.plain(&a[i*mk], &b[i*kn], &c[i*mn], m, n, k);
+          } else {
+            f.func(&a[i*mk], &b[i*kn], &c[i*mn], m, n, k, dist);
+          }
+        }
+      };
+      run();
+      counters.start();
+      const double ms = best_seconds(runs, run) * 1e3;
+      counters.stop();
+      char line[100];
+      int len = std::snprintf(line, sizeof(line), "%-10s %5d %11.2f %8.2f",
+                              f.name, dist, ms, flops / ms / 1e6);
+      // n/a if not counted, like print_counters
+      for (const int refill :
+           {PerfCounters::l1d_refill, PerfCounters::l2d_refill}) {
+        if (counters[refill] < 0) {
+          len += std::snprintf(line + len, sizeof(line) - len, " %11s",
+                               "n/a");
+        } else {
+          len += std::snprintf(line + len, sizeof(line) - len, " %11.3f",
+                               counters[refill] / (flops * runs) * 1e3);
+        }
+      }
+      std::cout << line << '\n';
+    }
+  }
+  return 0;
+}
+
+// benchmark or verify selected kernels with one matrix shape
+// - page faults of the warmup and the benchmark are reported, packing
+//   buffers come from a reused workspace, so the benchmark should be ~0
+// - machine: if given, the table places every kernel on its roofline;
+//   arithmetic intensity is flops over the compulsory bytes of a, b and c,
+//   each read or written once from dram, as the batch exceeds the caches
+int run(const std::unordered_set<std::string>& test_names, bool verify,
+        int batch, int m, int n, int k, const Machine* machine = nullptr) {
   float *a = new float[batch*m*k];
   float *b = new float[batch*k*n];
   float *c = new float[batch*m*n];
@@ -90,6 +1164,12 @@ int main(int argc, char* argv[]) {
   init_data(a, batch*m*k);
   init_data(b, batch*k*n);
 
+  // counters of the timed region of each kernel, opened once
+  static PerfCounters counters;
+  if (!verify && !counters.available()) {
+    std::cout << "perf counters unavailable: " << counters.error() << '\n';
+  }
+
   float *t = nullptr;
   if (verify) {
     std::cout << "calculate baseline result as ground truth\n";
@@ -99,12 +1179,15 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  for (auto [name, func] : mm_funcs) {
+  // benchmark time of each kernel, for the side by side table
+  std::vector<std::pair<std::string, double>> times;
+  for (auto [name, func, exact] : mm_funcs) {
     if (test_names.find(name) == test_names.end()) continue;
     if (verify && std::string(name) == "baseline") continue;
     std::cout << "========== " << name << " ==========\n";
 
     // warmup
+    const long warmup_faults = page_faults();
     for (long i = 0; i < batch; ++i) {
       func(a + i*m*k, b + i*k*n, c + i*m*n, m, n, k);
     }
@@ -112,7 +1195,9 @@ int main(int argc, char* argv[]) {
     if (verify) {
       // compare against baseline test result
       for (long i = 0; i < static_cast<long>(batch)*m*n; ++i) {
-        if (std::fabs(c[i] - t[i]) > FLT_MIN) {
+        const float tolerance =
+            exact ? FLT_MIN : k * FLT_EPSILON * std::fabs(t[i]);
+        if (std::fabs(c[i] - t[i]) > tolerance) {
           std::cerr << "FAILED! [" << i << "]: expect " << t[i] \
                     << ", get " << c[i] << '\n';
           return 1;
@@ -121,24 +1206,629 @@ int main(int argc, char* argv[]) {
       std::cout << "OK\n";
     } else {
       // benchnmark
+      const long bench_faults = page_faults();
+      counters.start();
       const auto start = std::chrono::high_resolution_clock::now();
       for (long i = 0; i < batch; ++i) {
         func(a + i*m*k, b + i*k*n, c + i*m*n, m, n, k);
       }
       const auto end = std::chrono::high_resolution_clock::now();
+      counters.stop();
       std::chrono::duration<double, std::milli> duration = end - start;
       std::cout << "time: " << duration.count() << " ms\n";
+      times.emplace_back(name, duration.count());
+      std::cout << "page faults: warmup " << bench_faults - warmup_faults \
+                << ", benchmark " << page_faults() - bench_faults << '\n';
+      print_counters(counters, 2.0 * batch * m * n * k);
 
       // print some results for quick debugging
       std::cerr << "c[0]    = " << c[0] << '\n';
-      std::cerr << "c[9973] = " << c[9973] << '\n';
+      if (batch*m*n > 9973) std::cerr << "c[9973] = " << c[9973] << '\n';
       std::cerr << "c[-1]   = " << c[batch*m*n - 1] << '\n';
     }
   }
 
+  // all kernels side by side, same data, timer and shape
+  if (times.size() > 1) {
+    const double best = std::min_element(times.begin(), times.end(),
+        [](const auto& x, const auto& y) { return x.second < y.second; })
+        ->second;
+    const double flops = 2.0 * batch * m * n * k;
+    const double bytes =
+        4.0 * batch * (static_cast<double>(m) * k + k * n + m * n);
+    const double ai = flops / bytes;
+    std::cout << "========== " << batch << " x " << m << 'x' << n << 'x' \
+              << k << " ==========\n";
+    if (machine) {
+      std::cout << "arithmetic intensity: " << ai << " flop/byte, roof " \
+                << machine->roof(ai) << " gflops, " \
+                << (ai * machine->dram_gbps < machine->peak_gflops
+                        ? "memory" : "compute") << " bound\n";
+    }
+    std::cout << "kernel               time (ms)   gflops  vs fastest" \
+              << (machine ? "  % of roof" : "") << '\n';
+    for (const auto& [name, ms] : times) {
+      char line[100];
+      const double gflops = flops / ms / 1e6;
+      const int len = std::snprintf(line, sizeof(line),
+                                    "%-18s %11.2f %8.2f %10.2fx",
+                                    name.c_str(), ms, gflops, ms / best);
+      if (machine) {
+        std::snprintf(line + len, sizeof(line) - len, " %10.1f%%",
+                      100 * gflops / machine->roof(ai));
+      }
+      std::cout << line << '\n';
+    }
+  }
+
+  // b is freed, drop its packs made by prepacked
+  sgemm_unpack_b(nullptr);
   delete[] a;
   delete[] b;
   delete[] c;
   delete[] t;
   return 0;
 }
+
+// one kernel on one shape of a sweep, times of one pass over the batch
+struct sweep_result {
+  std::string kernel;
+  int batch, m, n, k;
+  double min_ms, median_ms, p95_ms, gflops, peak_fraction;
+};
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  for (size_t end; (end = s.find(sep, start)) != std::string::npos;
+       start = end + 1) {
+    parts.push_back(s.substr(start, end - start));
+  }
+  parts.push_back(s.substr(start));
+  return parts;
+}
+
+// sizes of one dimension: list "64,100,128" or range "start:end[:step]",
+// step "*2" is geometric, default step 1; empty if invalid
+std::vector<int> parse_sizes(const std::string& arg) {
+  std::vector<int> sizes;
+  const auto range = split(arg, ':');
+  if (range.size() == 1) {
+    for (const auto& size : split(arg, ',')) {
+      sizes.push_back(std::atoi(size.c_str()));
+    }
+  } else if (range.size() <= 3) {
+    const int start = std::atoi(range[0].c_str());
+    const int end = std::atoi(range[1].c_str());
+    const std::string step = range.size() == 3 ? range[2] : "1";
+    const bool geometric = step[0] == '*';
+    const int s = std::atoi(step.c_str() + geometric);
+    if (s < (geometric ? 2 : 1)) return {};
+    for (int size = start; size > 0 && size <= end;
+         size = geometric ? size * s : size + s) {
+      sizes.push_back(size);
+    }
+  }
+  for (const int size : sizes) {
+    if (size <= 0) return {};
+  }
+  return sizes;
+}
+
+// percentile of sorted samples, nearest rank
+double percentile(const std::vector<double>& sorted, double p) {
+  const size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+// warmup runs, then reps timed runs of func over the batch
+sweep_result sweep_one(const char* name, mm_func func, int batch, int m,
+                       int n, int k, int warmup, int reps, double peak) {
+  const long mk = static_cast<long>(m) * k, kn = static_cast<long>(k) * n;
+  const long mn = static_cast<long>(m) * n;
+  std::vector<float> a(batch * mk), b(batch * kn), c(batch * mn);
+  init_data(a.data(), a.size());
+  init_data(b.data(), b.size());
+  auto pass = [&] {
+    for (long i = 0; i < batch; ++i) {
+      func(&a[i * mk], &b[i * kn], &c[i * mn], m, n, k);
+    }
+  };
+  for (int i = 0; i < warmup; ++i) pass();
+  std::vector<double> ms(reps);
+  for (auto& t : ms) t = best_seconds(1, pass) * 1e3;
+  std::sort(ms.begin(), ms.end());
+
+  sweep_result r{name, batch, m, n, k, ms[0], percentile(ms, 50),
+                 percentile(ms, 95)};
+  r.gflops = 2.0 * batch * mn * k / (r.median_ms * 1e-3) / 1e9;
+  r.peak_fraction = peak > 0 ? r.gflops / peak : 0;
+  return r;
+}
+
+// results of a former sweep, json or csv as written by sweep
+// - json: one object per line, fields looked up by name
+// - csv: header line, then fields in the order of the header
+std::vector<sweep_result> load_results(const std::string& path) {
+  std::vector<sweep_result> results;
+  std::ifstream file(path);
+  const bool csv = path.size() > 4 && path.substr(path.size() - 4) == ".csv";
+  std::vector<std::string> header;
+  for (std::string line; std::getline(file, line);) {
+    auto field = [&](const std::string& key) -> std::string {
+      if (csv) {
+        const auto fields = split(line, ',');
+        for (size_t i = 0; i < header.size() && i < fields.size(); ++i) {
+          if (header[i] == key) return fields[i];
+        }
+        return "";
+      }
+      const std::string tag = '"' + key + "\": ";
+      size_t pos = line.find(tag);
+      if (pos == std::string::npos) return "";
+      pos += tag.size();
+      if (line[pos] == '"') {
+        return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+      }
+      return line.substr(pos, line.find_first_of(",}", pos) - pos);
+    };
+    if (csv && header.empty()) {
+      header = split(line, ',');
+      continue;
+    }
+    const std::string kernel = field("kernel");
+    if (kernel.empty()) continue;
+    sweep_result r{kernel, std::atoi(field("batch").c_str()),
+                   std::atoi(field("m").c_str()), std::atoi(field("n").c_str()),
+                   std::atoi(field("k").c_str())};
+    r.min_ms = std::atof(field("min_ms").c_str());
+    r.median_ms = std::atof(field("median_ms").c_str());
+    r.p95_ms = std::atof(field("p95_ms").c_str());
+    r.gflops = std::atof(field("gflops").c_str());
+    r.peak_fraction = std::atof(field("peak_fraction").c_str());
+    results.push_back(r);
+  }
+  return results;
+}
+
+void save_results(const std::string& path,
+                  const std::vector<sweep_result>& results) {
+  std::ofstream file(path);
+  const bool csv = path.size() > 4 && path.substr(path.size() - 4) == ".csv";
+  if (csv) {
+    file << "kernel,batch,m,n,k,min_ms,median_ms,p95_ms,gflops," \
+            "peak_fraction\n";
+    for (const auto& r : results) {
+      file << r.kernel << ',' << r.batch << ',' << r.m << ',' << r.n << ',' \
+           << r.k << ',' << r.min_ms << ',' << r.median_ms << ',' \
+           << r.p95_ms << ',' << r.gflops << ',' << r.peak_fraction << '\n';
+    }
+    return;
+  }
+  file << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    file << "{\"kernel\": \"" << r.kernel << "\", \"batch\": " << r.batch \
+         << ", \"m\": " << r.m << ", \"n\": " << r.n << ", \"k\": " << r.k \
+         << ", \"min_ms\": " << r.min_ms << ", \"median_ms\": " \
+         << r.median_ms << ", \"p95_ms\": " << r.p95_ms << ", \"gflops\": " \
+         << r.gflops << ", \"peak_fraction\": " << r.peak_fraction << '}' \
+         << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  file << "]\n";
+}
+
+// median of every result against the same kernel and shape of a former
+// sweep, returns the number of regressions: slower by more than threshold %
+int compare_results(const std::vector<sweep_result>& results,
+                    const std::vector<sweep_result>& baseline,
+                    double threshold) {
+  int regressions = 0;
+  std::cout << "---------- compare, threshold " << threshold << "% " \
+            << "----------\n";
+  for (const auto& r : results) {
+    const auto it = std::find_if(baseline.begin(), baseline.end(),
+                                 [&](const sweep_result& b) {
+      return b.kernel == r.kernel && b.batch == r.batch && b.m == r.m &&
+             b.n == r.n && b.k == r.k;
+    });
+    std::cout << r.kernel << ' ' << r.batch << " x " << r.m << 'x' << r.n \
+              << 'x' << r.k << ": ";
+    if (it == baseline.end() || it->median_ms <= 0) {
+      std::cout << "not in baseline\n";
+      continue;
+    }
+    const double change = 100 * (r.median_ms / it->median_ms - 1);
+    std::cout << it->median_ms << " -> " << r.median_ms << " ms, " \
+              << (change > 0 ? "+" : "") << change << '%';
+    if (change > threshold) {
+      std::cout << "  REGRESSION";
+      ++regressions;
+    } else if (change < -threshold) {
+      std::cout << "  improved";
+    }
+    std::cout << '\n';
+  }
+  return regressions;
+}
+
+// shape sweep of selected kernels, see the usage below
+int sweep(int argc, char* argv[]) {
+  std::vector<std::string> kernels = {mm_funcs[n_funcs-1].name};
+  std::vector<std::array<int, 3>> shapes;
+  std::vector<int> ms, ns, ks;
+  int batch = 1, warmup = 2, reps = 10;
+  double peak = 0, threshold = 5;
+  std::string output, baseline;
+  for (int i = 2; i < argc; ++i) {
+    const std::string opt = argv[i];
+    if (i + 1 == argc) {
+      std::cerr << "missing value of " << opt << '\n';
+      return 1;
+    }
+    const std::string value = argv[++i];
+    if (opt == "--kernels") {
+      kernels = split(value, ',');
+      if (value == "all") {
+        kernels.clear();
+        for (const auto& f : mm_funcs) kernels.push_back(f.name);
+      }
+    } else if (opt == "--shapes") {
+      for (const auto& shape : split(value, ',')) {
+        const auto mnk = split(shape, 'x');
+        if (mnk.size() != 3) {
+          std::cerr << "invalid shape: " << shape << '\n';
+          return 1;
+        }
+        shapes.push_back({std::atoi(mnk[0].c_str()),
+                          std::atoi(mnk[1].c_str()),
+                          std::atoi(mnk[2].c_str())});
+      }
+    } else if (opt == "-m" || opt == "-n" || opt == "-k") {
+      auto& sizes = opt == "-m" ? ms : opt == "-n" ? ns : ks;
+      sizes = parse_sizes(value);
+      if (sizes.empty()) {
+        std::cerr << "invalid sizes: " << value << '\n';
+        return 1;
+      }
+    } else if (opt == "--batch") {
+      batch = std::atoi(value.c_str());
+    } else if (opt == "--warmup") {
+      warmup = std::atoi(value.c_str());
+    } else if (opt == "--reps") {
+      reps = std::atoi(value.c_str());
+    } else if (opt == "--peak") {
+      peak = value == "probe" ? peak_gflops() : std::atof(value.c_str());
+    } else if (opt == "--output") {
+      output = value;
+    } else if (opt == "--compare") {
+      baseline = value;
+    } else if (opt == "--threshold") {
+      threshold = std::atof(value.c_str());
+    } else {
+      std::cerr << "unknown option: " << opt << '\n';
+      return 1;
+    }
+  }
+
+  // -m -n -k: every combination, a missing one is the benchmark shape's
+  if (!ms.empty() || !ns.empty() || !ks.empty()) {
+    if (ms.empty()) ms = {1000};
+    if (ns.empty()) ns = {240};
+    if (ks.empty()) ks = {200};
+    for (const int m : ms) {
+      for (const int n : ns) {
+        for (const int k : ks) shapes.push_back({m, n, k});
+      }
+    }
+  }
+  if (shapes.empty()) shapes = {{1000, 240, 200}, {128, 128, 128},
+                                {512, 512, 512}};
+  for (const auto [m, n, k] : shapes) {
+    if (m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+  }
+  if (batch <= 0 || warmup < 0 || reps <= 0) {
+    std::cerr << "invalid batch, warmup or reps\n";
+    return 1;
+  }
+  std::vector<mm_func> funcs;
+  for (const auto& kernel : kernels) {
+    const auto it = std::find_if(
+        std::begin(mm_funcs), std::end(mm_funcs),
+        [&](const auto& f) { return kernel == f.name; });
+    if (it == std::end(mm_funcs)) {
+      std::cerr << "unknown benchmark: " << kernel << '\n';
+      return 1;
+    }
+    funcs.push_back(it->func);
+  }
+
+  std::cout << "kernel batch m n k min_ms median_ms p95_ms gflops" \
+            << (peak > 0 ? " %peak" : "") << '\n';
+  std::vector<sweep_result> results;
+  for (const auto [m, n, k] : shapes) {
+    for (size_t i = 0; i < kernels.size(); ++i) {
+      const auto r = sweep_one(kernels[i].c_str(), funcs[i], batch, m, n, k,
+                               warmup, reps, peak);
+      std::cout << r.kernel << ' ' << r.batch << ' ' << r.m << ' ' << r.n \
+                << ' ' << r.k << ' ' << r.min_ms << ' ' << r.median_ms \
+                << ' ' << r.p95_ms << ' ' << r.gflops;
+      if (peak > 0) std::cout << ' ' << 100 * r.peak_fraction;
+      std::cout << '\n';
+      results.push_back(r);
+    }
+  }
+  sgemm_unpack_b(nullptr);
+
+  if (!output.empty()) save_results(output, results);
+  if (!baseline.empty()) {
+    const auto saved = load_results(baseline);
+    if (saved.empty()) {
+      std::cerr << "no results in " << baseline << '\n';
+      return 1;
+    }
+    return compare_results(results, saved, threshold) ? 1 : 0;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  bool verify = false;
+  std::unordered_set<std::string> test_names;
+  // run last test if no specified
+  std::string test_name = argc > 1 ? argv[1] : mm_funcs[n_funcs-1].name;
+  if (test_name == "sweep") {
+    return sweep(argc, argv);
+  } else if (test_name == "small") {
+    return bench_small();
+  } else if (test_name == "int8") {
+    // int8 kernels, default is the benchmark shape
+    int m = 1000, n = 240, k = 200;
+    if (argc == 5) {
+      m = std::atoi(argv[2]);
+      n = std::atoi(argv[3]);
+      k = std::atoi(argv[4]);
+    }
+    if (m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_int8(m, n, k);
+  } else if (test_name == "f64" || test_name == "c32") {
+    // double or complex float kernels, default is the benchmark shape
+    int m = 1000, n = 240, k = 200;
+    if (argc == 5) {
+      m = std::atoi(argv[2]);
+      n = std::atoi(argv[3]);
+      k = std::atoi(argv[4]);
+    }
+    if (m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    if (test_name == "f64") {
+      return test_f64() || bench_typed(_mm_baseline_f64, f64_funcs, m, n, k);
+    }
+    return test_c32() || bench_typed(_mm_baseline_c32, c32_funcs, m, n, k);
+  } else if (test_name == "half") {
+    // bf16/fp16 kernels, default shapes are bound by reading b
+    if (test_half()) return 1;
+    if (argc == 5) {
+      const int m = std::atoi(argv[2]);
+      const int n = std::atoi(argv[3]);
+      const int k = std::atoi(argv[4]);
+      if (m <= 0 || n <= 0 || k <= 0) {
+        std::cerr << "invalid size\n";
+        return 1;
+      }
+      return bench_half(m, n, k);
+    }
+    const int shapes[][3] = {{1, 4096, 4096}, {16, 4096, 4096},
+                             {1000, 240, 200}};
+    for (const auto [m, n, k] : shapes) {
+      if (bench_half(m, n, k)) return 1;
+    }
+    return 0;
+  } else if (test_name == "prefetch") {
+    // prefetch distance sweep, default is the benchmark shape with a
+    // smaller batch, still well beyond the caches
+    int batch = 64, m = 1000, n = 240, k = 200;
+    if (argc == 6) {
+      batch = std::atoi(argv[2]);
+      m = std::atoi(argv[3]);
+      n = std::atoi(argv[4]);
+      k = std::atoi(argv[5]);
+    }
+    if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_prefetch(batch, m, n, k);
+  } else if (test_name == "grouped") {
+    // moe like: 32 experts of up to 64 tokens each
+    int count = 32, m_max = 64, n = 1024, k = 512;
+    if (argc == 6) {
+      count = std::atoi(argv[2]);
+      m_max = std::atoi(argv[3]);
+      n = std::atoi(argv[4]);
+      k = std::atoi(argv[5]);
+    }
+    if (count <= 0 || m_max <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_grouped(count, m_max, n, k);
+  } else if (test_name == "batched") {
+    // many small matrices by default
+    int batch = 4096, m = 16, n = 32, k = 32;
+    if (argc == 6) {
+      batch = std::atoi(argv[2]);
+      m = std::atoi(argv[3]);
+      n = std::atoi(argv[4]);
+      k = std::atoi(argv[5]);
+    }
+    if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_batched(batch, m, n, k);
+  } else if (test_name == "epilogue") {
+    // fused epilogues, default is the benchmark shape with a smaller batch
+    int batch = 64, m = 1000, n = 240, k = 200;
+    if (argc == 6) {
+      batch = std::atoi(argv[2]);
+      m = std::atoi(argv[3]);
+      n = std::atoi(argv[4]);
+      k = std::atoi(argv[5]);
+    }
+    if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_epilogue(batch, m, n, k);
+  } else if (test_name == "gemv") {
+    // matrix vector shape, default is a 4096 x 4096 layer
+    int n = 4096, k = 4096;
+    if (argc == 4) {
+      n = std::atoi(argv[2]);
+      k = std::atoi(argv[3]);
+    }
+    if (n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return bench_gemv(n, k);
+  } else if (test_name == "tune") {
+    // autotune one shape, default is the benchmark shape
+    int m = 1000, n = 240, k = 200;
+    if (argc == 5) {
+      m = std::atoi(argv[2]);
+      n = std::atoi(argv[3]);
+      k = std::atoi(argv[4]);
+    }
+    if (m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    const char* best = mm_autotune(m, n, k, true);
+    std::cout << "best: " << best << '\n';
+    return 0;
+  } else if (test_name == "list") {
+    // list all benchmarks
+    for (const auto& f : mm_funcs) {
+      std::cout << f.name << '\n';
+    }
+    return 0;
+  } else if (test_name == "roofline") {
+    // all kernels on the roofline of this core, batch m n k (optional)
+    const Machine machine = Machine::probe();
+    for (const auto& f : mm_funcs) test_names.insert(f.name);
+    int batch = 512, m = 1000, n = 240, k = 200;
+    if (argc == 6) {
+      batch = std::atoi(argv[2]);
+      m = std::atoi(argv[3]);
+      n = std::atoi(argv[4]);
+      k = std::atoi(argv[5]);
+    }
+    if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+    return run(test_names, false, batch, m, n, k, &machine);
+  } else if (test_name == "backends") {
+    // the fastest kernels of mm.cc against every library built in
+    test_names = {"tile-transpose", "blocked", "llamafile", "blis", "onednn"};
+  } else if (test_name == "all" || test_name == "test") {
+    // run all benchmarks
+    for (const auto& f : mm_funcs) {
+      test_names.insert(f.name);
+    }
+    // verify test results
+    verify = test_name == "test";
+  } else {
+    // run specific benchmark
+    for (const auto& f : mm_funcs) {
+      if (test_name == f.name) {
+        test_names.insert(f.name);
+        break;
+      }
+    }
+    if (test_names.empty()) {
+      std::cerr << "unknown benchmark: " << test_name << '\n';
+      std::cerr << "supported options: \n";
+      std::cerr << "- list:   list all benchmark name\n";
+      std::cerr << "- all:    run all benchmarks\n";
+      std::cerr << "- roofline: peak and bandwidth probe, then all " \
+                   "kernels on the roofline, batch m n k (optional)\n";
+      std::cerr << "- backends: mm.cc vs the libraries built in, " \
+                   "batch m n k (optional)\n";
+      std::cerr << "- test:   verify all benchmarks\n";
+      std::cerr << "- tune:   autotune shape m n k (optional)\n";
+      std::cerr << "- sweep:  shape sweep with statistics, options:\n" \
+                   "    --kernels a,b | all   (default: blocked)\n" \
+                   "    --shapes 1000x240x200,64x64x64\n" \
+                   "    -m/-n/-k 64,128 | 64:1024:64 | 64:1024:*2\n" \
+                   "    --batch 1 --warmup 2 --reps 10\n" \
+                   "    --peak gflops|probe   (for %peak)\n" \
+                   "    --output r.json|r.csv --compare r.json|r.csv\n" \
+                   "    --threshold 5         (% slower is a regression)\n";
+      std::cerr << "- small:  ns per call of fixed shape small kernels\n";
+      std::cerr << "- gemv:   GB/s of m == 1 and n == 1, n k (optional)\n";
+      std::cerr << "- epilogue: fused vs separate epilogue passes, " \
+                   "batch m n k (optional)\n";
+      std::cerr << "- batched: mm_batched vs a loop of calls, " \
+                   "batch m n k (optional)\n";
+      std::cerr << "- grouped: mm_grouped vs a loop of calls, " \
+                   "count m_max n k (optional)\n";
+      std::cerr << "- prefetch: prefetch distance sweep of the asm " \
+                   "kernels, batch m n k (optional)\n";
+      std::cerr << "- int8:   int8 vs fp32 tile kernels, m n k (optional)\n";
+      std::cerr << "- half:   bf16/fp16 vs fp32 kernels, m n k (optional)\n";
+      std::cerr << "- f64:    double kernels, m n k (optional)\n";
+      std::cerr << "- c32:    complex float kernels, m n k (optional)\n";
+      std::cerr << "- [name]: specify valid benchmark name\n";
+      std::cerr << "optional matrix shape after the option: batch m n k\n";
+      return 1;
+    }
+  }
+
+  // default batch size and matrix shape
+  int batch = 512;
+  int m = 1000, n = 240, k = 200;
+  if (argc == 6) {
+    batch = std::atoi(argv[2]);
+    m = std::atoi(argv[3]);
+    n = std::atoi(argv[4]);
+    k = std::atoi(argv[5]);
+    if (batch <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid size\n";
+      return 1;
+    }
+  }
+
+  if (verify && argc != 6) {
+    // besides the benchmark shape, cover unaligned edges, matrices smaller
+    // than one register tile and multiple cache blocks
+    const int shapes[][4] = {
+      // batch,    m,   n,   k
+      {    512, 1000, 240, 200},
+      {     16, 1000, 250, 197},
+      {     64,    7,   5,   3},
+      {      4,  300, 260, 600},
+      {     64,    1, 999, 203},
+      {     64,  999,   1, 201},
+    };
+    for (const auto [batch, m, n, k] : shapes) {
+      std::cout << "---------- " << m << 'x' << n << 'x' << k \
+                << " ----------\n";
+      if (run(test_names, verify, batch, m, n, k)) return 1;
+    }
+    return test_sgemm() || test_small() || test_epilogue() ||
+           test_batched() || test_grouped() || test_int8() ||
+           test_half() || test_f64() || test_c32() || test_prefetch();
+  }
+  return run(test_names, verify, batch, m, n, k);
+}
@@ -0,0 +1,188 @@
+// generate asm register tile micro kernels of several shapes: mm-ukr.S
+// $ ./mm-ukr-gen > mm-ukr.S
+//
+// void mm_ukr_<h>x<w>_asm(const float* a_pack, const float* b_pack,
+//                         float* c, long ldc, long k)
+// - c[h][w] = sum(a_pack[kk][h] * b_pack[kk][w]), kk = 0 ~ k-1
+// - a_pack: tile_height floats per k (one column of a), see pack_a_cols
+// - b_pack: tile_width floats per k (one row of b), see pack_b
+// - c: row stride ldc floats, all tile_height * tile_width written
+//
+// per k step the tile is one rank 1 update, loads: (h + w) / 4 vectors,
+// fmla: h * w / 4, so larger and squarer tiles have better fma/load ratio
+// - tile_a[h/4]:      v0 ~
+// - tile_b[w/4]:      next to tile_a
+// - tile_c[h][w/4]:   ~ v31, the top of the register file
+// - v8 ~ v15 are saved only if used (lower 64 bits are callee saved)
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Shape {
+  int tile_height;
+  int tile_width;
+};
+
+// register tile shapes to generate
+const Shape shapes[] = {
+  { 8,  8},
+  {12,  8},
+  { 8, 12},
+  {16,  4},
+  { 4, 16},
+};
+
+// load or store n vector registers from v<first> at [ptr], ldp/stp pairs
+// - post_inc: advance ptr by the bytes accessed, else access [ptr + offset]
+void emit_vectors(const char* op_pair, const char* op, int first, int n,
+                  const char* ptr, bool post_inc) {
+  for (int i = 0; i < n; i += 2) {
+    std::string addr = std::string("[") + ptr;
+    if (post_inc) {
+      addr += "], #" + std::to_string(n - i >= 2 ? 32 : 16);
+    } else {
+      addr += i ? ", #" + std::to_string(i * 16) + "]" : "]";
+    }
+    if (n - i >= 2) {
+      std::printf("        %-5s q%d, q%d, %s\n", op_pair, first + i,
+                  first + i + 1, addr.c_str());
+    } else {
+      std::printf("        %-5s q%d, %s\n", op, first + i, addr.c_str());
+    }
+  }
+}
+
+// one k step: load a column of a and a row of b, rank 1 update of tile c
+void emit_k_step(const Shape& shape, int reg_a, int reg_b, int reg_c) {
+  const int h_vecs = shape.tile_height / 4;
+  const int w_vecs = shape.tile_width / 4;
+  emit_vectors("ldp", "ldr", reg_a, h_vecs, "a_ptr", true);
+  emit_vectors("ldp", "ldr", reg_b, w_vecs, "b_ptr", true);
+  for (int h = 0; h < shape.tile_height; ++h) {
+    for (int w = 0; w < w_vecs; ++w) {
+      std::printf("        fmla  v%d.4s, v%d.4s, v%d.s[%d]\n",
+                  reg_c + h * w_vecs + w, reg_b + w, reg_a + h / 4, h % 4);
+    }
+  }
+}
+
+void emit_kernel(const Shape& shape) {
+  const int th = shape.tile_height, tw = shape.tile_width;
+  const int h_vecs = th / 4, w_vecs = tw / 4;
+  const int reg_a = 0, reg_b = reg_a + h_vecs, reg_ab_end = reg_b + w_vecs;
+  const int reg_c = 32 - th * w_vecs;
+  if (th % 4 || tw % 4 || reg_ab_end > reg_c) {
+    std::fprintf(stderr, "%dx%d: tile does not fit registers\n", th, tw);
+    std::exit(1);
+  }
+
+  // callee saved registers used by the kernel, saved in pairs
+  std::vector<int> saved;
+  for (int r = 8; r <= 15; ++r) {
+    if (r < reg_ab_end || r >= reg_c) saved.push_back(r);
+  }
+  const int frame = (saved.size() * 8 + 15) / 16 * 16;
+
+  const std::string name =
+      "mm_ukr_" + std::to_string(th) + "x" + std::to_string(tw) + "_asm";
+  const char* sym = name.c_str();
+
+  std::printf("\n        .global %s\n\n%s:\n\n", sym, sym);
+  std::printf("        // general registers\n");
+  std::printf("        a_ptr .req x0\n");
+  std::printf("        b_ptr .req x1\n");
+  std::printf("        c_ptr .req x2\n");
+  std::printf("        ldc   .req x3\n");
+  std::printf("        k     .req x4\n");
+  std::printf("        k4    .req x5\n");
+  std::printf("        tmp   .req x6\n\n");
+  std::printf("        // vector registers\n");
+  std::printf("        // - tile_a[%d]:    v%d ~ v%d\n", h_vecs, reg_a,
+              reg_b - 1);
+  std::printf("        // - tile_b[%d]:    v%d ~ v%d\n", w_vecs, reg_b,
+              reg_ab_end - 1);
+  std::printf("        // - tile_c[%d][%d]: v%d ~ v31\n\n", th, w_vecs,
+              reg_c);
+
+  if (frame) {
+    std::printf("        sub   sp, sp, #%d\n", frame);
+    for (size_t i = 0; i < saved.size(); i += 2) {
+      if (i + 1 < saved.size()) {
+        std::printf("        stp   d%d, d%d, [sp, #%zu]\n", saved[i],
+                    saved[i + 1], i * 8);
+      } else {
+        std::printf("        str   d%d, [sp, #%zu]\n", saved[i], i * 8);
+      }
+    }
+    std::printf("\n");
+  }
+
+  std::printf("        // clear c tile registers\n");
+  for (int r = reg_c; r < 32; ++r) {
+    std::printf("        movi  v%d.4s, #0\n", r);
+  }
+  std::printf("\n");
+
+  std::printf("        // k rounded down to 4 and the remainder\n");
+  std::printf("        and   k4, k, #~3\n");
+  std::printf("        sub   k, k, k4\n");
+  std::printf("        cbz   k4, .L%s_k1\n", sym);
+  std::printf(".L%s_k4:\n", sym);
+  for (int i = 0; i < 4; ++i) {
+    std::printf("        // k + %d\n", i);
+    emit_k_step(shape, reg_a, reg_b, reg_c);
+  }
+  std::printf("        subs  k4, k4, #4\n");
+  std::printf("        b.ne  .L%s_k4\n", sym);
+  std::printf(".L%s_k1:\n", sym);
+  std::printf("        cbz   k, .L%s_store\n", sym);
+  std::printf(".L%s_k1_loop:\n", sym);
+  emit_k_step(shape, reg_a, reg_b, reg_c);
+  std::printf("        subs  k, k, #1\n");
+  std::printf("        b.ne  .L%s_k1_loop\n", sym);
+  std::printf(".L%s_store:\n\n", sym);
+
+  std::printf("        // populate tile c\n");
+  std::printf("        lsl   ldc, ldc, #2\n");
+  std::printf("        mov   tmp, c_ptr\n");
+  for (int h = 0; h < th; ++h) {
+    emit_vectors("stp", "str", reg_c + h * w_vecs, w_vecs, "tmp", false);
+    if (h + 1 < th) std::printf("        add   tmp, tmp, ldc\n");
+  }
+  std::printf("\n");
+
+  if (frame) {
+    for (size_t i = 0; i < saved.size(); i += 2) {
+      if (i + 1 < saved.size()) {
+        std::printf("        ldp   d%d, d%d, [sp, #%zu]\n", saved[i],
+                    saved[i + 1], i * 8);
+      } else {
+        std::printf("        ldr   d%d, [sp, #%zu]\n", saved[i], i * 8);
+      }
+    }
+    std::printf("        add   sp, sp, #%d\n", frame);
+  }
+  std::printf("        ret\n\n");
+
+  for (const char* reg : {"a_ptr", "b_ptr", "c_ptr", "ldc", "k", "k4",
+                          "tmp"}) {
+    std::printf("        .unreq %s\n", reg);
+  }
+}
+
+int main() {
+  std::printf("/*\n");
+  std::printf(" * generated by mm-ukr-gen.cc, do not edit\n");
+  std::printf(" *\n");
+  std::printf(" * register tile micro kernels, c = a_pack * b_pack\n");
+  std::printf(" * void mm_ukr_<h>x<w>_asm(const float* a_pack, "
+              "const float* b_pack,\n");
+  std::printf(" *                         float* c, long ldc, long k)\n");
+  std::printf(" */\n\n");
+  std::printf("        .text\n");
+  std::printf("        .arch armv8.2-a\n");
+  for (const auto& shape : shapes) emit_kernel(shape);
+  return 0;
+}
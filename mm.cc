@@ -1,15 +1,38 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <arm_neon.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "mm.h"
+#include "multi-thread/thread-pool.h"
 
 // visit both a and b in rows, cache friendly
 // - c[row] = a[row][0]*b[0] + a[row][1]*b[1] + ... + a[row][k-1]*b[k-1]
-static void mm_baseline(const float* __restrict a, const float* __restrict b,
-                        float* __restrict c, int m, int n, int k) {
-  const float *a_ptr = a;
-  float *c_ptr = c;
+// - T: float, double or std::complex<float>
+template <typename T = float>
+static void mm_baseline(const T* __restrict a, const T* __restrict b,
+                        T* __restrict c, int m, int n, int k) {
+  const T *a_ptr = a;
+  T *c_ptr = c;
   for (int row = 0; row < m; ++row) {
-    const float *b_ptr = b;
+    const T *b_ptr = b;
     for (int col = 0; col < n; ++col) {
       c_ptr[col] = a_ptr[0] * b_ptr[col];
     }
@@ -24,42 +47,456 @@ static void mm_baseline(const float* __restrict a, const float* __restrict b,
   }
 }
 
+// one row of a column panel: c[row][0 ~ cols-1], cols < col_blk_size only at
+// the right edge of c
+template <int col_blk_size, bool edge>
+static inline void mm_panel_row(const float* __restrict a_ptr,
+                                const float* __restrict b_ptr,
+                                float* __restrict c_ptr, int n, int k,
+                                int cols) {
+  const int width = edge ? cols : col_blk_size;
+  float v[col_blk_size]{};
+  int i = 0;
+  for (; i + 4 <= k; i += 4) {
+    for (int j = 0; j < width; ++j) {
+      v[j] += a_ptr[i] * b_ptr[j];
+    }
+    b_ptr += n;
+    for (int j = 0; j < width; ++j) {
+      v[j] += a_ptr[i+1] * b_ptr[j];
+    }
+    b_ptr += n;
+    for (int j = 0; j < width; ++j) {
+      v[j] += a_ptr[i+2] * b_ptr[j];
+    }
+    b_ptr += n;
+    for (int j = 0; j < width; ++j) {
+      v[j] += a_ptr[i+3] * b_ptr[j];
+    }
+    b_ptr += n;
+  }
+  // k remainder
+  for (; i < k; ++i) {
+    for (int j = 0; j < width; ++j) {
+      v[j] += a_ptr[i] * b_ptr[j];
+    }
+    b_ptr += n;
+  }
+  std::memcpy(c_ptr, v, width * sizeof(float));
+}
+
 // calculate c by column panels, re-use b panel in cache
 // - c[0][00~23], c[1][00~23], ...
 // - c[0][24~47], c[1][24,27], ...
 template <int col_blk_size = 24>
 static void mm_panel(const float* __restrict a, const float* __restrict b,
                      float* __restrict c, int m, int n, int k) {
-  // XXX: ignore edge case for now
-  if (n % col_blk_size != 0 && k % 4 == 0) std::abort();
-
   for (int col = 0; col < n; col += col_blk_size) {
+    const int cols = std::min(col_blk_size, n - col);
     const float* a_ptr = a;
     float* c_ptr = c + col;
     for (int row = 0; row < m; ++row) {
-      const float* b_ptr = b + col;
-      float v[col_blk_size]{};
-      for (int i = 0; i < k; i += 4) {
-        for (int j = 0; j < col_blk_size; ++j) {
-          v[j] += a_ptr[i] * b_ptr[j];
+      if (cols == col_blk_size) {
+        mm_panel_row<col_blk_size, false>(a_ptr, b + col, c_ptr, n, k, cols);
+      } else {
+        mm_panel_row<col_blk_size, true>(a_ptr, b + col, c_ptr, n, k, cols);
+      }
+      a_ptr += k;
+      c_ptr += n;
+    }
+  }
+}
+
+// activation of the fused epilogue
+enum class Activation { none, relu, gelu };
+
+// gelu(x) = x / 2 * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3)))
+// - tanh(u) = u * p(u^2) / q(u^2), u clamped to +-7.9988, abs error < 4e-7
+//   (the rational approximation of eigen's fast tanh)
+// - same steps as the gelu macro of mm-tile.S
+static inline float32x4_t gelu(float32x4_t x) {
+  // sqrt(2 / pi), sqrt(2 / pi) * 0.044715
+  const float sqrt_2_pi = 0.7978845608f, cubic = 0.0356774081f;
+  const float clamp = 7.99881172f;
+  const float p_coef[] = {-2.76076847742355e-16f, 2.00018790482477e-13f,
+                          -8.60467152213735e-11f, 5.12229709037114e-08f,
+                          1.48572235717979e-05f,  6.37261928875436e-04f,
+                          4.89352455891786e-03f};
+  const float q_coef[] = {1.19825839466702e-06f, 1.18534705686654e-04f,
+                          2.26843463243900e-03f, 4.89352518554385e-03f};
+
+  const float32x4_t x2 = vmulq_f32(x, x);
+  float32x4_t u = vfmaq_n_f32(vdupq_n_f32(sqrt_2_pi), x2, cubic);
+  u = vmulq_f32(u, x);
+  u = vmaxq_f32(vminq_f32(u, vdupq_n_f32(clamp)), vdupq_n_f32(-clamp));
+  const float32x4_t u2 = vmulq_f32(u, u);
+  float32x4_t p = vdupq_n_f32(p_coef[0]);
+  for (int i = 1; i < 7; ++i) p = vfmaq_f32(vdupq_n_f32(p_coef[i]), p, u2);
+  float32x4_t q = vdupq_n_f32(q_coef[0]);
+  for (int i = 1; i < 4; ++i) q = vfmaq_f32(vdupq_n_f32(q_coef[i]), q, u2);
+  const float32x4_t t = vdivq_f32(vmulq_f32(p, u), q);
+  return vmulq_n_f32(vmulq_f32(vaddq_f32(t, vdupq_n_f32(1.f)), x), 0.5f);
+}
+
+// epilogue of the tile kernels: c = act(a * b + bias) + residual
+// - applied to the register tile before it is stored, c is written once
+//   instead of once per elementwise pass
+// - bias: one per column of c, if has_bias
+// - residual: same shape as c with row stride ldr, must not alias c, if
+//   has_residual
+// - offset(): the epilogue of the sub matrix of c starting at [row][col]
+// - apply(): 4 columns of row h starting at column w, the first cols of them
+//   are valid, the others are not loaded
+template <bool has_bias, Activation act, bool has_residual>
+struct Epilogue {
+  static constexpr bool none =
+      !has_bias && act == Activation::none && !has_residual;
+
+  const float* bias;
+  const float* residual;
+  int ldr;
+
+  Epilogue offset(int row, int col) const {
+    return {has_bias ? bias + col : nullptr,
+            has_residual ? residual + row * ldr + col : nullptr, ldr};
+  }
+
+  float32x4_t apply(float32x4_t v, int h, int w, int cols) const {
+    if constexpr (has_bias) v = vaddq_f32(v, load(bias + w, cols));
+    if constexpr (act == Activation::relu) {
+      v = vmaxq_f32(v, vdupq_n_f32(0.f));
+    } else if constexpr (act == Activation::gelu) {
+      v = gelu(v);
+    }
+    if constexpr (has_residual) {
+      v = vaddq_f32(v, load(residual + h * ldr + w, cols));
+    }
+    return v;
+  }
+
+ private:
+  static float32x4_t load(const float* ptr, int cols) {
+    if (cols == 4) return vld1q_f32(ptr);
+    float tmp[4] = {};
+    std::memcpy(tmp, ptr, cols * sizeof(float));
+    return vld1q_f32(tmp);
+  }
+};
+using EpilogueNone = Epilogue<false, Activation::none, false>;
+
+// calculate one register tile of c: tile_c = a[rows][k] * b[k][cols]
+// - a_ptr: packed row panel (tile_height * 4 floats per step) if packed_a,
+//          else row major with stride k
+// - b_ptr: packed column panel (4 * tile_width floats per step) if packed_b,
+//          else row major with stride n
+// - packed panels are zero padded, so only the store is masked for them
+// - unpacked a must hold tile_height rows; unpacked b may be narrower than
+//   tile_width, the missing columns are masked on load
+// - k % 4 remainder is accumulated one column of a at a time
+// - n: row stride of c, and of b if it is not packed
+// - accumulate: continue the sum of the existing c tile, exact as if k were
+//   not split, requires alpha == 1 and beta == 0
+// - store phase: c = alpha * tile_c + beta * c, c is not read if beta == 0,
+//   then the epilogue, which must be none if the sum is continued later
+template <int tile_height, int tile_width, bool packed_a, bool packed_b,
+          typename Epilogue = EpilogueNone>
+static inline void mm_tile_kernel(const float* __restrict a_ptr,
+                                  const float* __restrict b_ptr,
+                                  float* __restrict c_ptr, int n, int k,
+                                  int rows, int cols,
+                                  bool accumulate = false,
+                                  float alpha = 1.f, float beta = 0.f,
+                                  const Epilogue& epilogue = {}) {
+  // a: tile_height * 4; b: 4 * tile_width; c: tile_height * tile_width
+  float32x4_t tile_a[tile_height];
+  float32x4_t tile_b[4][tile_width / 4];
+  float32x4_t tile_c[tile_height][tile_width / 4];
+
+  // make sure all floating point numbers can be held in neon registers
+  const int total_size = sizeof(tile_a) + sizeof(tile_b) + sizeof(tile_c);
+  static_assert(total_size <= 32 * 16);
+  static_assert(tile_width % 4 == 0);
+
+  const bool full_b = packed_b || cols == tile_width;
+  const bool full_c = rows == tile_height && cols == tile_width;
+
+  // calculate tile c
+  if (accumulate) {
+    if (!full_c) std::memset(tile_c, 0, sizeof(tile_c));
+    for (int h = 0; h < rows; ++h) {
+      std::memcpy(tile_c[h], c_ptr + h * n, cols * sizeof(float));
+    }
+  } else {
+    std::memset(tile_c, 0, sizeof(tile_c));
+  }
+  // kk: iterate panel_a by 4 cols and panel_b by 4 rows (one vector)
+  const int k4 = k & ~3;
+  for (int kk = 0; kk < k4; kk += 4) {
+    // load tile a: rows = tile_height, cols = 4
+    if (packed_a) {
+      std::memcpy(tile_a, a_ptr, sizeof(tile_a));
+      a_ptr += sizeof(tile_a) / 4/*sizeof(float)*/;
+    } else {
+      for (int h = 0; h < tile_height; ++h) {
+        std::memcpy(&tile_a[h], a_ptr + h * k, 4 * sizeof(float));
+      }
+      a_ptr += 4;
+    }
+
+    // load tile b: rows = 4, cols = tile_width
+    if (packed_b) {
+      std::memcpy(tile_b, b_ptr, sizeof(tile_b));
+      b_ptr += sizeof(tile_b) / 4/*sizeof(float)*/;
+    } else {
+      if (!full_b) std::memset(tile_b, 0, sizeof(tile_b));
+      for (int i = 0; i < 4; ++i) {
+        std::memcpy(tile_b[i], b_ptr + i * n, cols * sizeof(float));
+      }
+      b_ptr += 4 * n;
+    }
+
+    // accumulate c tile, all data are in registers
+    // tile_c += tile_a * tile_b
+    for (int h = 0; h < tile_height; ++h) {
+      for (int w = 0; w < tile_width; w += 4) {
+        tile_c[h][w/4] += tile_a[h][0] * tile_b[0][w/4];
+        tile_c[h][w/4] += tile_a[h][1] * tile_b[1][w/4];
+        tile_c[h][w/4] += tile_a[h][2] * tile_b[2][w/4];
+        tile_c[h][w/4] += tile_a[h][3] * tile_b[3][w/4];
+      }
+    }
+  }
+
+  // k remainder: one row of b against one column of a
+  for (int kk = k4; kk < k; ++kk) {
+    const int i = kk - k4;
+    if (packed_b) {
+      std::memcpy(tile_b[0], b_ptr + i * tile_width, sizeof(tile_b[0]));
+    } else {
+      if (!full_b) std::memset(tile_b[0], 0, sizeof(tile_b[0]));
+      std::memcpy(tile_b[0], b_ptr + i * n, cols * sizeof(float));
+    }
+    for (int h = 0; h < tile_height; ++h) {
+      const float a_val = packed_a ? a_ptr[h * 4 + i] : a_ptr[h * k + i];
+      for (int w = 0; w < tile_width; w += 4) {
+        tile_c[h][w/4] += a_val * tile_b[0][w/4];
+      }
+    }
+  }
+
+  // scale by alpha, add beta * c
+  if (alpha != 1.f) {
+    for (int h = 0; h < tile_height; ++h) {
+      for (int w = 0; w < tile_width; w += 4) {
+        tile_c[h][w/4] *= alpha;
+      }
+    }
+  }
+  if (beta != 0.f) {
+    for (int h = 0; h < rows; ++h) {
+      float32x4_t c_old[tile_width / 4];
+      if (!full_c) std::memset(c_old, 0, sizeof(c_old));
+      std::memcpy(c_old, c_ptr + h * n, cols * sizeof(float));
+      for (int w = 0; w < tile_width; w += 4) {
+        tile_c[h][w/4] += beta * c_old[w/4];
+      }
+    }
+  }
+
+  // fused epilogue, only on the valid part of the tile
+  if constexpr (!Epilogue::none) {
+    const int h_end = full_c ? tile_height : rows;
+    const int w_end = full_c ? tile_width : cols;
+    for (int h = 0; h < h_end; ++h) {
+      for (int w = 0; w < w_end; w += 4) {
+        tile_c[h][w/4] =
+            epilogue.apply(tile_c[h][w/4], h, w, std::min(4, w_end - w));
+      }
+    }
+  }
+
+  // store to c tile
+  if (full_c) {
+    for (int h = 0; h < tile_height; ++h) {
+      std::memcpy(c_ptr + h * n, tile_c[h], tile_width * sizeof(float));
+    }
+  } else {
+    for (int h = 0; h < rows; ++h) {
+      std::memcpy(c_ptr + h * n, tile_c[h], cols * sizeof(float));
+    }
+  }
+}
+
+// edge tile, split unpacked b into 4 wide column strips: 8x4, 4x4, 1x4
+template <int tile_height, int tile_width, bool packed_a, bool packed_b,
+          typename Epilogue = EpilogueNone>
+static void mm_tile_edge_cols(const float* __restrict a_ptr,
+                              const float* __restrict b_ptr,
+                              float* __restrict c_ptr, int n, int k,
+                              int rows, int cols,
+                              const Epilogue& epilogue = {}) {
+  if (packed_b || cols == tile_width) {
+    mm_tile_kernel<tile_height, tile_width, packed_a, packed_b>(
+        a_ptr, b_ptr, c_ptr, n, k, rows, cols, false, 1.f, 0.f, epilogue);
+    return;
+  }
+  for (int w = 0; w < cols; w += 4) {
+    mm_tile_kernel<tile_height, 4, packed_a, false>(
+        a_ptr, b_ptr + w, c_ptr + w, n, k, rows, std::min(4, cols - w),
+        false, 1.f, 0.f, epilogue.offset(0, w));
+  }
+}
+
+// edge tile, split unpacked a into row strips: 4xN, 1xN
+template <int tile_height, int tile_width, bool packed_a, bool packed_b,
+          typename Epilogue = EpilogueNone>
+static void mm_tile_edge(const float* __restrict a_ptr,
+                         const float* __restrict b_ptr,
+                         float* __restrict c_ptr, int n, int k,
+                         int rows, int cols,
+                         const Epilogue& epilogue = {}) {
+  if (packed_a || rows == tile_height) {
+    mm_tile_edge_cols<tile_height, tile_width, packed_a, packed_b>(
+        a_ptr, b_ptr, c_ptr, n, k, rows, cols, epilogue);
+    return;
+  }
+  int h = 0;
+  if (tile_height > 4) {
+    for (; h + 4 <= rows; h += 4) {
+      mm_tile_edge_cols<4, tile_width, false, packed_b>(
+          a_ptr + h * k, b_ptr, c_ptr + h * n, n, k, 4, cols,
+          epilogue.offset(h, 0));
+    }
+  }
+  for (; h < rows; ++h) {
+    mm_tile_edge_cols<1, tile_width, false, packed_b>(
+        a_ptr + h * k, b_ptr, c_ptr + h * n, n, k, 1, cols,
+        epilogue.offset(h, 0));
+  }
+}
+
+// thread local scratch memory for the packing buffers, reused by all calls
+// - grows to the largest size requested, never shrinks, freed at thread exit
+// - 64 byte aligned; 2M aligned and advised to use transparent huge pages if
+//   env MM_HUGE_PAGES is set
+// - growing invalidates the old memory, so a caller carves all its buffers
+//   out of one get()
+class Workspace {
+ public:
+  ~Workspace() { std::free(data_); }
+
+  float* get(size_t floats) {
+    if (floats <= size_) return data_;
+    static const bool huge = std::getenv("MM_HUGE_PAGES") != nullptr;
+    const size_t align = huge ? (2 << 20) : 64;
+    const size_t bytes = (floats * sizeof(float) + align - 1) / align * align;
+    std::free(data_);
+    void* p = nullptr;
+    if (posix_memalign(&p, align, bytes)) std::abort();
+    if (huge) madvise(p, bytes, MADV_HUGEPAGE);
+    data_ = static_cast<float*>(p);
+    size_ = bytes / sizeof(float);
+    return data_;
+  }
+
+ private:
+  float* data_{};
+  size_t size_{};
+};
+
+static float* thread_workspace(size_t floats) {
+  static thread_local Workspace workspace;
+  return workspace.get(floats);
+}
+
+// round up to whole cache lines, keeps carved buffers 64 byte aligned
+static size_t cache_lines(size_t floats) { return (floats + 15) & ~size_t{15}; }
+
+// pack rows * cols of a (row stride lda) into row panels of tile_height rows
+// - each panel is stored one neon vector of columns at a time: step = 4
+//   columns of float, 2 of double or complex float, tile_height * step
+//   elements per step
+// - panels are zero padded to tile_height rows and to a multiple of step
+// - trans: a is stored transposed, element [row][col] is a[col * lda + row]
+template <int tile_height, bool trans = false, typename T>
+static void pack_a(const T* __restrict a, int lda,
+                   T* __restrict a_tx, int rows, int cols) {
+  constexpr int step = 16 / sizeof(T);
+  for (int mm = 0; mm < rows; mm += tile_height) {
+    const int h_cnt = std::min(tile_height, rows - mm);
+    for (int col = 0; col < cols; col += step) {
+      const int w_cnt = std::min(step, cols - col);
+      if (h_cnt < tile_height || w_cnt < step) {
+        std::memset(a_tx, 0, tile_height * step * sizeof(T));
+      }
+      if (trans) {
+        for (int j = 0; j < w_cnt; ++j) {
+          const T* a_ptr = a + (col + j) * lda + mm;
+          for (int row = 0; row < h_cnt; ++row) {
+            a_tx[row * step + j] = a_ptr[row];
+          }
         }
-        b_ptr += n;
-        for (int j = 0; j < col_blk_size; ++j) {
-          v[j] += a_ptr[i+1] * b_ptr[j];
+      } else {
+        const T* a_ptr = a + mm * lda + col;
+        for (int row = 0; row < h_cnt; ++row) {
+          std::memcpy(a_tx + row * step, a_ptr + row * lda,
+                      w_cnt * sizeof(T));
         }
-        b_ptr += n;
-        for (int j = 0; j < col_blk_size; ++j) {
-          v[j] += a_ptr[i+2] * b_ptr[j];
+      }
+      a_tx += tile_height * step;
+    }
+  }
+}
+
+// pack rows * cols of b (row stride ldb) into column panels of tile_width
+// - each panel is stored row by row: tile_width per step
+// - panels are zero padded to tile_width columns
+// - trans: b is stored transposed, element [row][col] is b[col * ldb + row]
+template <int tile_width, bool trans = false, typename T>
+static void pack_b(const T* __restrict b, int ldb,
+                   T* __restrict b_tx, int rows, int cols) {
+  for (int nn = 0; nn < cols; nn += tile_width) {
+    const int w_cnt = std::min(tile_width, cols - nn);
+    if (trans) {
+      if (w_cnt < tile_width) {
+        std::memset(b_tx, 0, rows * tile_width * sizeof(T));
+      }
+      for (int w = 0; w < w_cnt; ++w) {
+        const T* b_ptr = b + (nn + w) * ldb;
+        for (int row = 0; row < rows; ++row) {
+          b_tx[row * tile_width + w] = b_ptr[row];
         }
-        b_ptr += n;
-        for (int j = 0; j < col_blk_size; ++j) {
-          v[j] += a_ptr[i+3] * b_ptr[j];
+      }
+      b_tx += rows * tile_width;
+    } else {
+      const T* b_ptr = b + nn;
+      for (int row = 0; row < rows; ++row) {
+        if (w_cnt < tile_width) {
+          std::memset(b_tx, 0, tile_width * sizeof(T));
         }
-        b_ptr += n;
+        std::memcpy(b_tx, b_ptr + row * ldb, w_cnt * sizeof(T));
+        b_tx += tile_width;
       }
-      std::memcpy(c_ptr, v, sizeof(v));
-      a_ptr += k;
-      c_ptr += n;
+    }
+  }
+}
+
+// pack rows * cols of a (row stride lda) into row panels of tile_height rows
+// - each panel is stored one column at a time: tile_height per step, the
+//   layout of the generated asm micro kernels (mm-ukr-gen.cc)
+// - panels are zero padded to tile_height rows
+template <int tile_height>
+static void pack_a_cols(const float* __restrict a, int lda,
+                        float* __restrict a_tx, int rows, int cols) {
+  for (int mm = 0; mm < rows; mm += tile_height) {
+    const int h_cnt = std::min(tile_height, rows - mm);
+    const float* a_ptr = a + mm * lda;
+    for (int col = 0; col < cols; ++col) {
+      for (int row = 0; row < h_cnt; ++row) {
+        a_tx[row] = a_ptr[row * lda + col];
+      }
+      for (int row = h_cnt; row < tile_height; ++row) a_tx[row] = 0.f;
+      a_tx += tile_height;
     }
   }
 }
@@ -68,57 +505,46 @@ static void mm_panel(const float* __restrict a, const float* __restrict b,
 // - visit a by row panels, b by column panels
 // - reduce memory accesses and total instructions
 // - clang16 vectorizes the code quite good: https://godbolt.org/z/MWvefG6ds
+// - any shape is supported, edge tiles run through smaller register tiles
+// - epilogue: fused into the store of every tile, see Epilogue
 template <int tile_height = 8, int tile_width = 8,
-          bool transpose_a = true, bool transpose_b = true>
+          bool transpose_a = true, bool transpose_b = true,
+          typename Epilogue>
 static void mm_tile(const float* __restrict a, const float* __restrict b,
-                    float* __restrict c, int m, int n, int k) {
-  // XXX: ignore edge case for now
+                    float* __restrict c, int m, int n, int k,
+                    const Epilogue& epilogue) {
   static_assert(tile_height % 4 == 0 && tile_width % 4 == 0);
-  if (m % tile_height || n % tile_width || k % 4) std::abort();
+
+  // k of packed a is padded to 4, m and n to tile size
+  const int k_pad = (k + 3) & ~3;
+  const int m_pad = (m + tile_height - 1) / tile_height * tile_height;
+  const int n_pad = (n + tile_width - 1) / tile_width * tile_width;
+
+  // packing buffers from the thread local workspace
+  const size_t a_size = transpose_a ? cache_lines(m_pad * k_pad) : 0;
+  const size_t b_size = transpose_b ? k * n_pad : 0;
+  float* ws = a_size + b_size ? thread_workspace(a_size + b_size) : nullptr;
 
   // transpose each row panel of a for sequential memory access
   float* a_tx{};
   if (transpose_a) {
-    a_tx = new float[m * k];
-    float* a_tx_ptr = a_tx;
-    for (int mm = 0; mm < m; mm += tile_height) {
-      const float* a_ptr = a + mm * k;
-      for (int col = 0; col < k; col += 4) {
-        for (int row = 0; row < tile_height; ++row) {
-          std::memcpy(a_tx_ptr, a_ptr + row * k + col, 4 * sizeof(float));
-          a_tx_ptr += 4;
-        }
-      }
-    }
+    a_tx = ws;
+    pack_a<tile_height>(a, k, a_tx, m, k);
   }
 
   // transpose each column panel of b for sequential memory access
   float* b_tx{};
   if (transpose_b) {
-    b_tx = new float[k * n];
-    float* b_tx_ptr = b_tx;
-    for (int nn = 0; nn < n; nn += tile_width) {
-      const float* b_ptr = b + nn;
-      for (int row = 0; row < k; ++row) { 
-        std::memcpy(b_tx_ptr, b_ptr + row * n, tile_width * sizeof(float));
-        b_tx_ptr += tile_width;
-      }
-    }
+    b_tx = ws + a_size;
+    pack_b<tile_width>(b, n, b_tx, k, n);
   }
 
-  // a: tile_height * 4; b: 4 * tile_width; c: tile_height * tile_width
-  float32x4_t tile_a[tile_height];
-  float32x4_t tile_b[4][tile_width / 4];
-  float32x4_t tile_c[tile_height][tile_width / 4];
-
-  // make sure all floating point numbers can be held in neon registers
-  const int total_size = sizeof(tile_a) + sizeof(tile_b) + sizeof(tile_c);
-  static_assert(total_size <= 32 * 16);
-
   // nn: start column of matrix c's tile under calculation
   for (int nn = 0; nn < n; nn += tile_width) {
+    const int cols = std::min(tile_width, n - nn);
     // mm: start row of matrix c's tile under calculation
     for (int mm = 0; mm < m; mm += tile_height) {
+      const int rows = std::min(tile_height, m - mm);
       // calculate c tile starts from [mm, nn]
       //
       // panel a:              panel b:                tile c:
@@ -135,67 +561,1614 @@ static void mm_tile(const float* __restrict a, const float* __restrict b,
       // v     |         |                           v     |             |
       // ......+---------+                           ......+-------------+
       //       |<-- k -->|                                 |<---- n ---->|
-      const float* a_ptr = (transpose_a ? a_tx : a) + mm * k;
+      const float* a_ptr = transpose_a ? (a_tx + mm * k_pad) : (a + mm * k);
       const float* b_ptr = transpose_b ? (b_tx + nn * k) : (b + nn);
       float *c_ptr = c + mm * n + nn;
 
-      // calculate tile c
-      std::memset(tile_c, 0, sizeof(tile_c));
-      // kk: iterate panel_a by 4 cols and panel_b by 4 rows (one vector)
-      for (int kk = 0; kk < k; kk += 4) {
-        // load tile a: rows = tile_height, cols = 4
-        if (transpose_a) {
-          std::memcpy(tile_a, a_ptr, sizeof(tile_a));
-          a_ptr += sizeof(tile_a) / 4/*sizeof(float)*/;
-        } else {
-          for (int h = 0; h < tile_height; ++h) {
-            std::memcpy(&tile_a[h], a_ptr + h * k, 4 * sizeof(float));
-          }
-          a_ptr += 4;
-        }
+      const Epilogue tile_epilogue = epilogue.offset(mm, nn);
+      if (rows == tile_height && cols == tile_width) {
+        mm_tile_kernel<tile_height, tile_width, transpose_a, transpose_b>(
+            a_ptr, b_ptr, c_ptr, n, k, rows, cols, false, 1.f, 0.f,
+            tile_epilogue);
+      } else {
+        mm_tile_edge<tile_height, tile_width, transpose_a, transpose_b>(
+            a_ptr, b_ptr, c_ptr, n, k, rows, cols, tile_epilogue);
+      }
+    }
+  }
+}
 
-        // load tile b: rows = 4, cols = tile_width
-        if (transpose_b) {
-          std::memcpy(tile_b, b_ptr, sizeof(tile_b));
-          b_ptr += sizeof(tile_b) / 4/*sizeof(float)*/;
-        } else {
-          for (int i = 0; i < 4; ++i) {
-            std::memcpy(tile_b[i], b_ptr + i * n, tile_width * sizeof(float));
-          }
-          b_ptr += 4 * n;
+template <int tile_height = 8, int tile_width = 8,
+          bool transpose_a = true, bool transpose_b = true>
+static void mm_tile(const float* __restrict a, const float* __restrict b,
+                    float* __restrict c, int m, int n, int k) {
+  mm_tile<tile_height, tile_width, transpose_a, transpose_b>(
+      a, b, c, m, n, k, EpilogueNone{});
+}
+
+// c = act(a * b + bias) + residual by mm_tile with the epilogue fused
+// - bias and residual are ignored unless enabled, residual is m x n
+template <int tile_height, int tile_width, bool transpose_a, bool transpose_b,
+          bool has_bias, Activation act, bool has_residual>
+static void mm_tile_fused(const float* __restrict a,
+                          const float* __restrict b, float* __restrict c,
+                          int m, int n, int k, const float* bias,
+                          const float* residual) {
+  mm_tile<tile_height, tile_width, transpose_a, transpose_b>(
+      a, b, c, m, n, k,
+      Epilogue<has_bias, act, has_residual>{bias, residual, n});
+}
+
+// call f(std::integral_constant<int, 0>) ~ f(...<int, n - 1>) in order,
+// unrolled at compile time
+template <typename F, int... i>
+static inline void unroll(F&& f, std::integer_sequence<int, i...>) {
+  (f(std::integral_constant<int, i>{}), ...);
+}
+template <int n, typename F>
+static inline void unroll(F&& f) {
+  unroll(f, std::make_integer_sequence<int, n>{});
+}
+
+// rows * cols tile of a small gemm, a/b/c row major in place, see mm_small
+// - same register tiles as mm_tile_kernel, k fully unrolled
+template <int N, int K, int rows, int cols>
+static inline void mm_small_tile(const float* __restrict a,
+                                 const float* __restrict b,
+                                 float* __restrict c) {
+  float32x4_t tile_c[rows][cols / 4];
+  unroll<rows>([&](auto h) {
+    unroll<cols / 4>([&](auto w) { tile_c[h][w] = vdupq_n_f32(0.f); });
+  });
+
+  // kk: 4 columns of a in registers, 4 rows of b
+  unroll<K / 4>([&](auto kb) {
+    constexpr int kk = decltype(kb)::value * 4;
+    float32x4_t tile_a[rows];
+    unroll<rows>([&](auto h) { tile_a[h] = vld1q_f32(a + h * K + kk); });
+    unroll<4>([&](auto i) {
+      constexpr int lane = decltype(i)::value;
+      unroll<cols / 4>([&](auto w) {
+        const float32x4_t tile_b = vld1q_f32(b + (kk + lane) * N + w * 4);
+        unroll<rows>([&](auto h) {
+          tile_c[h][w] = vfmaq_laneq_f32(tile_c[h][w], tile_b, tile_a[h],
+                                         lane);
+        });
+      });
+    });
+  });
+  // k % 4 remainder, one column of a at a time
+  unroll<K % 4>([&](auto i) {
+    constexpr int kk = K / 4 * 4 + decltype(i)::value;
+    unroll<cols / 4>([&](auto w) {
+      const float32x4_t tile_b = vld1q_f32(b + kk * N + w * 4);
+      unroll<rows>([&](auto h) {
+        tile_c[h][w] = vfmaq_n_f32(tile_c[h][w], tile_b, a[h * K + kk]);
+      });
+    });
+  });
+
+  unroll<rows>([&](auto h) {
+    unroll<cols / 4>([&](auto w) {
+      vst1q_f32(c + h * N + w * 4, tile_c[h][w]);
+    });
+  });
+}
+
+// c = a * b of a small matrix with the shape known at compile time
+// - no packing and no heap, a/b/c are read in place (the problem is in L1)
+// - 8x8 register tiles, k fully unrolled, tile loops have constant bounds
+// - bottom edge is a shorter tile, right edge a 4 wide tile
+// - N must be a multiple of 4
+template <int M, int N, int K>
+static void mm_small(const float* __restrict a, const float* __restrict b,
+                     float* __restrict c) {
+  static_assert(N % 4 == 0 && M > 0 && K > 0);
+  constexpr int m8 = M / 8 * 8, n8 = N / 8 * 8;
+  for (int nn = 0; nn < n8; nn += 8) {
+    for (int mm = 0; mm < m8; mm += 8) {
+      mm_small_tile<N, K, 8, 8>(a + mm * K, b + nn, c + mm * N + nn);
+    }
+    if constexpr (M % 8 != 0) {
+      mm_small_tile<N, K, M % 8, 8>(a + m8 * K, b + nn, c + m8 * N + nn);
+    }
+  }
+  if constexpr (N % 8 != 0) {
+    for (int mm = 0; mm < m8; mm += 8) {
+      mm_small_tile<N, K, 8, 4>(a + mm * K, b + n8, c + mm * N + n8);
+    }
+    if constexpr (M % 8 != 0) {
+      mm_small_tile<N, K, M % 8, 4>(a + m8 * K, b + n8, c + m8 * N + n8);
+    }
+  }
+}
+
+// pack rows * cols of int8 a (row stride lda) into row panels of 8 rows
+// - each panel is stored 2 columns at a time: 8 rows of column col, then 8
+//   rows of column col + 1, 16 bytes per step
+// - panels are zero padded to 8 rows and to an even number of columns
+static void pack_a_s8(const int8_t* __restrict a, int lda,
+                      int8_t* __restrict a_tx, int rows, int cols) {
+  const int cols_pad = (cols + 1) & ~1;
+  for (int mm = 0; mm < rows; mm += 8) {
+    const int h_cnt = std::min(8, rows - mm);
+    const int8_t* a_ptr = a + static_cast<long>(mm) * lda;
+    for (int col = 0; col < cols_pad; ++col) {
+      for (int row = 0; row < 8; ++row) {
+        a_tx[row] = row < h_cnt && col < cols ? a_ptr[row * lda + col] : 0;
+      }
+      a_tx += 8;
+    }
+  }
+}
+
+// pack rows * cols of int8 b (row stride ldb) into column panels of 8
+// - each panel is stored row by row: 8 bytes per step, 2 rows per load
+// - panels are zero padded to 8 columns and to an even number of rows
+static void pack_b_s8(const int8_t* __restrict b, int ldb,
+                      int8_t* __restrict b_tx, int rows, int cols) {
+  const int rows_pad = (rows + 1) & ~1;
+  for (int nn = 0; nn < cols; nn += 8) {
+    const int w_cnt = std::min(8, cols - nn);
+    for (int row = 0; row < rows_pad; ++row) {
+      std::memset(b_tx, 0, 8);
+      if (row < rows) std::memcpy(b_tx, b + row * ldb + nn, w_cnt);
+      b_tx += 8;
+    }
+  }
+}
+
+// store phase of the int8 tile kernel: the int32 sums as they are
+struct StoreS32 {
+  int32_t* c;
+  int ldc;
+
+  void operator()(const int32x4_t (&tile_c)[8][2], int row, int col,
+                  int rows, int cols) const {
+    for (int h = 0; h < rows; ++h) {
+      int32_t* c_ptr = c + static_cast<long>(row + h) * ldc + col;
+      if (cols == 8) {
+        vst1q_s32(c_ptr, tile_c[h][0]);
+        vst1q_s32(c_ptr + 4, tile_c[h][1]);
+      } else {
+        int32_t line[8];
+        vst1q_s32(line, tile_c[h][0]);
+        vst1q_s32(line + 4, tile_c[h][1]);
+        std::memcpy(c_ptr, line, cols * sizeof(int32_t));
+      }
+    }
+  }
+};
+
+// store phase of the int8 tile kernel: requantize the int32 sums to int8
+// - c = saturate(round(sum * scale) + zero_point), round half to even
+// - scale folds the scales of a, b and c: scale_a * scale_b / scale_c
+// - sums are converted to float, exact up to 2^24
+struct RequantizeS8 {
+  int8_t* c;
+  int ldc;
+  float scale;
+  int zero_point;
+
+  void operator()(const int32x4_t (&tile_c)[8][2], int row, int col,
+                  int rows, int cols) const {
+    const int32x4_t zp = vdupq_n_s32(zero_point);
+    for (int h = 0; h < rows; ++h) {
+      int32x4_t v[2];
+      for (int w = 0; w < 2; ++w) {
+        const float32x4_t f = vmulq_n_f32(vcvtq_f32_s32(tile_c[h][w]), scale);
+        v[w] = vqaddq_s32(vcvtnq_s32_f32(f), zp);
+      }
+      const int8x8_t q = vqmovn_s16(vcombine_s16(vqmovn_s32(v[0]),
+                                                 vqmovn_s32(v[1])));
+      int8_t* c_ptr = c + static_cast<long>(row + h) * ldc + col;
+      if (cols == 8) {
+        vst1_s8(c_ptr, q);
+      } else {
+        int8_t line[8];
+        vst1_s8(line, q);
+        std::memcpy(c_ptr, line, cols);
+      }
+    }
+  }
+};
+
+// one 8x8 tile of int32 sums: tile_c = a[8][k] * b[k][8]
+// - a_ptr, b_ptr: panels packed by pack_a_s8 and pack_b_s8, k_pad steps
+// - 2 steps of k per 16 byte load of a and of b, sign extended to int16
+//   (sxtl, sxtl2)
+// - widening multiply-accumulate by lane, smlal / smlal2: int16 products
+//   summed in int32, the whole int8 range is exact for k < 2^17
+// - register use is that of the fp32 tile: 16 accumulators, 4 + 2 inputs
+template <typename Store>
+static inline void mm_s8_tile_kernel(const int8_t* __restrict a_ptr,
+                                     const int8_t* __restrict b_ptr,
+                                     int k_pad, int row, int col, int rows,
+                                     int cols, const Store& store) {
+  int32x4_t tile_c[8][2];
+  for (int h = 0; h < 8; ++h) {
+    tile_c[h][0] = tile_c[h][1] = vdupq_n_s32(0);
+  }
+
+  for (int kk = 0; kk < k_pad; kk += 2) {
+    const int8x16_t a_s8 = vld1q_s8(a_ptr);
+    const int8x16_t b_s8 = vld1q_s8(b_ptr);
+    a_ptr += 16;
+    b_ptr += 16;
+    const int16x8_t tile_a[2] = {vmovl_s8(vget_low_s8(a_s8)),
+                                 vmovl_high_s8(a_s8)};
+    const int16x8_t tile_b[2] = {vmovl_s8(vget_low_s8(b_s8)),
+                                 vmovl_high_s8(b_s8)};
+    for (int i = 0; i < 2; ++i) {
+      unroll<8>([&](auto h) {
+        constexpr int lane = decltype(h)::value;
+        tile_c[lane][0] = vmlal_laneq_s16(
+            tile_c[lane][0], vget_low_s16(tile_b[i]), tile_a[i], lane);
+        tile_c[lane][1] = vmlal_high_laneq_s16(
+            tile_c[lane][1], tile_b[i], tile_a[i], lane);
+      });
+    }
+  }
+
+  store(tile_c, row, col, rows, cols);
+}
+
+// c = a * b of int8 a and b, int32 sums, dense row major
+// - a and b are packed whole into the thread local workspace, edge tiles
+//   are zero padded, so every tile runs the full 8x8 kernel and only the
+//   store is masked
+// - store: StoreS32 or RequantizeS8, fused into the store of every tile
+template <typename Store>
+static void mm_s8(const int8_t* __restrict a, const int8_t* __restrict b,
+                  int m, int n, int k, const Store& store) {
+  const int m_pad = (m + 7) / 8 * 8, n_pad = (n + 7) / 8 * 8;
+  const int k_pad = (k + 1) & ~1;
+  // sizes in floats of the workspace, 4 int8 per float
+  const size_t a_size = cache_lines((static_cast<size_t>(m_pad) * k_pad + 3)
+                                    / 4);
+  const size_t b_size = (static_cast<size_t>(k_pad) * n_pad + 3) / 4;
+  float* ws = thread_workspace(a_size + b_size);
+  int8_t* a_tx = reinterpret_cast<int8_t*>(ws);
+  int8_t* b_tx = reinterpret_cast<int8_t*>(ws + a_size);
+  pack_a_s8(a, k, a_tx, m, k);
+  pack_b_s8(b, n, b_tx, k, n);
+
+  for (int nn = 0; nn < n; nn += 8) {
+    const int cols = std::min(8, n - nn);
+    for (int mm = 0; mm < m; mm += 8) {
+      const int rows = std::min(8, m - mm);
+      mm_s8_tile_kernel(a_tx + static_cast<long>(mm) * k_pad,
+                        b_tx + static_cast<long>(nn) * k_pad, k_pad, mm, nn,
+                        rows, cols, store);
+    }
+  }
+}
+
+// int8 gemm with the int32 sums stored
+static void mm_s8s32(const int8_t* a, const int8_t* b, int32_t* c,
+                     int m, int n, int k) {
+  mm_s8(a, b, m, n, k, StoreS32{c, n});
+}
+
+// int8 gemm requantized to int8 in the store, see RequantizeS8
+static void mm_s8_requantize(const int8_t* a, const int8_t* b, int8_t* c,
+                             int m, int n, int k, float scale,
+                             int zero_point) {
+  mm_s8(a, b, m, n, k, RequantizeS8{c, n, scale, zero_point});
+}
+
+// 16 bit floating point storage of a and b, raw bits in uint16_t
+// - bf16: the high half of a float, widened by a 16 bit shift (shll)
+// - fp16: ieee half precision, widened by fcvtl
+// - products are summed in fp32, c is fp32
+enum class Half { bf16, fp16 };
+
+template <Half fmt>
+static inline float half_to_float(uint16_t h) {
+  if constexpr (fmt == Half::bf16) {
+    const uint32_t bits = static_cast<uint32_t>(h) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  } else {
+    float16_t f;
+    std::memcpy(&f, &h, sizeof(f));
+    return f;
+  }
+}
+
+template <Half fmt>
+static inline float32x4_t widen(uint16x4_t h) {
+  if constexpr (fmt == Half::bf16) {
+    return vreinterpretq_f32_u32(vshll_n_u16(h, 16));
+  } else {
+    return vcvt_f32_f16(vreinterpret_f16_u16(h));
+  }
+}
+
+// 8 halves widened to 2 fp32 vectors, the first cols are loaded, the others
+// are zero
+template <Half fmt>
+static inline void load_half_8(const uint16_t* ptr, int cols,
+                               float32x4_t (&v)[2]) {
+  uint16x8_t h;
+  if (cols == 8) {
+    h = vld1q_u16(ptr);
+  } else {
+    uint16_t line[8] = {};
+    std::memcpy(line, ptr, cols * sizeof(uint16_t));
+    h = vld1q_u16(line);
+  }
+  v[0] = widen<fmt>(vget_low_u16(h));
+  v[1] = widen<fmt>(vget_high_u16(h));
+}
+
+// pack_a of 16 bit a: the same fp32 layout, widened while it is packed
+template <int tile_height, Half fmt>
+static void pack_a_half(const uint16_t* __restrict a, int lda,
+                        float* __restrict a_tx, int rows, int cols) {
+  for (int mm = 0; mm < rows; mm += tile_height) {
+    const int h_cnt = std::min(tile_height, rows - mm);
+    for (int col = 0; col < cols; col += 4) {
+      const int w_cnt = std::min(4, cols - col);
+      for (int row = 0; row < tile_height; ++row) {
+        float32x4_t v = vdupq_n_f32(0.f);
+        if (row < h_cnt) {
+          uint16_t h[4] = {};
+          std::memcpy(h, a + static_cast<long>(mm + row) * lda + col,
+                      w_cnt * sizeof(uint16_t));
+          v = widen<fmt>(vld1_u16(h));
         }
+        vst1q_f32(a_tx + row * 4, v);
+      }
+      a_tx += tile_height * 4;
+    }
+  }
+}
 
-        // accumulate c tile, all data are in registers
-        // tile_c += tile_a * tile_b
-        for (int h = 0; h < tile_height; ++h) {
-          for (int w = 0; w < tile_width; w += 4) {
-            tile_c[h][w/4] += tile_a[h][0] * tile_b[0][w/4];
-            tile_c[h][w/4] += tile_a[h][1] * tile_b[1][w/4];
-            tile_c[h][w/4] += tile_a[h][2] * tile_b[2][w/4];
-            tile_c[h][w/4] += tile_a[h][3] * tile_b[3][w/4];
-          }
+// one 8x8 tile of c = a * b with b read in place as halves
+// - a_ptr: row panel packed by pack_a_half, fp32
+// - b_ptr: row major halves with row stride n, the first cols are valid
+// - each row of b is widened in registers as it is loaded, tile_c sums in
+//   fp32, the register use of mm_tile_kernel<8, 8>
+// - k % 4 remainder is accumulated one column of a at a time
+template <Half fmt>
+static inline void mm_tile_half_kernel(const float* __restrict a_ptr,
+                                       const uint16_t* __restrict b_ptr,
+                                       float* __restrict c_ptr, int n,
+                                       int k, int rows, int cols) {
+  float32x4_t tile_c[8][2];
+  for (int h = 0; h < 8; ++h) {
+    tile_c[h][0] = tile_c[h][1] = vdupq_n_f32(0.f);
+  }
+
+  const int k4 = k & ~3;
+  for (int kk = 0; kk < k4; kk += 4) {
+    float32x4_t tile_a[8];
+    for (int h = 0; h < 8; ++h) tile_a[h] = vld1q_f32(a_ptr + h * 4);
+    a_ptr += 8 * 4;
+    unroll<4>([&](auto i) {
+      constexpr int lane = decltype(i)::value;
+      float32x4_t tile_b[2];
+      load_half_8<fmt>(b_ptr + lane * n, cols, tile_b);
+      for (int h = 0; h < 8; ++h) {
+        tile_c[h][0] = vfmaq_laneq_f32(tile_c[h][0], tile_b[0], tile_a[h],
+                                       lane);
+        tile_c[h][1] = vfmaq_laneq_f32(tile_c[h][1], tile_b[1], tile_a[h],
+                                       lane);
+      }
+    });
+    b_ptr += 4 * n;
+  }
+  for (int i = 0; i < k - k4; ++i) {
+    float32x4_t tile_b[2];
+    load_half_8<fmt>(b_ptr + i * n, cols, tile_b);
+    for (int h = 0; h < 8; ++h) {
+      tile_c[h][0] = vfmaq_n_f32(tile_c[h][0], tile_b[0], a_ptr[h * 4 + i]);
+      tile_c[h][1] = vfmaq_n_f32(tile_c[h][1], tile_b[1], a_ptr[h * 4 + i]);
+    }
+  }
+
+  for (int h = 0; h < rows; ++h) {
+    float* c_row = c_ptr + h * n;
+    if (cols == 8) {
+      vst1q_f32(c_row, tile_c[h][0]);
+      vst1q_f32(c_row + 4, tile_c[h][1]);
+    } else {
+      float line[8];
+      vst1q_f32(line, tile_c[h][0]);
+      vst1q_f32(line + 4, tile_c[h][1]);
+      std::memcpy(c_row, line, cols * sizeof(float));
+    }
+  }
+}
+
+// c = a * b of 16 bit a and b, fp32 c, dense row major
+// - a is widened to fp32 while it is packed; b, the large operand of the
+//   memory bound shapes, is never upconverted, it is read as halves at half
+//   the bytes of fp32
+// - an 8 column panel of b is reused by all row panels of a
+template <Half fmt>
+static void mm_tile_half(const uint16_t* __restrict a,
+                         const uint16_t* __restrict b, float* __restrict c,
+                         int m, int n, int k) {
+  const int k_pad = (k + 3) & ~3;
+  const int m_pad = (m + 7) / 8 * 8;
+  float* a_tx = thread_workspace(static_cast<size_t>(m_pad) * k_pad);
+  pack_a_half<8, fmt>(a, k, a_tx, m, k);
+
+  for (int nn = 0; nn < n; nn += 8) {
+    const int cols = std::min(8, n - nn);
+    for (int mm = 0; mm < m; mm += 8) {
+      const int rows = std::min(8, m - mm);
+      mm_tile_half_kernel<fmt>(a_tx + static_cast<long>(mm) * k_pad, b + nn,
+                               c + static_cast<long>(mm) * n + nn, n, k,
+                               rows, cols);
+    }
+  }
+}
+
+// calculate c by column panels of 24 as mm_panel, a and b read as halves
+// - one row of the panel is 6 fp32 vectors in registers, each row of b is
+//   widened as it is loaded, one element of a per step of k
+// - no packing and no workspace
+template <Half fmt>
+static void mm_panel_half(const uint16_t* __restrict a,
+                          const uint16_t* __restrict b, float* __restrict c,
+                          int m, int n, int k) {
+  constexpr int col_blk_size = 24;
+  for (int col = 0; col < n; col += col_blk_size) {
+    const int cols = std::min(col_blk_size, n - col);
+    for (int row = 0; row < m; ++row) {
+      const uint16_t* a_ptr = a + static_cast<long>(row) * k;
+      const uint16_t* b_ptr = b + col;
+      float32x4_t v[col_blk_size / 4];
+      for (auto& x : v) x = vdupq_n_f32(0.f);
+      for (int i = 0; i < k; ++i) {
+        const float a_val = half_to_float<fmt>(a_ptr[i]);
+        for (int j = 0; j < col_blk_size / 8; ++j) {
+          float32x4_t b_vec[2];
+          load_half_8<fmt>(b_ptr + j * 8, std::clamp(cols - j * 8, 0, 8),
+                           b_vec);
+          v[j * 2] = vfmaq_n_f32(v[j * 2], b_vec[0], a_val);
+          v[j * 2 + 1] = vfmaq_n_f32(v[j * 2 + 1], b_vec[1], a_val);
         }
+        b_ptr += n;
       }
+      float line[col_blk_size];
+      for (int j = 0; j < col_blk_size / 4; ++j) vst1q_f32(line + j * 4, v[j]);
+      std::memcpy(c + static_cast<long>(row) * n + col, line,
+                  cols * sizeof(float));
+    }
+  }
+}
 
-      // store to c tile
+// calculate one register tile of double c: tile_c = a[rows][k] * b[k][cols]
+// - mm_tile_kernel with float64x2_t, 2 lanes instead of 4
+// - a_ptr: row panel packed by pack_a, 2 columns per step
+// - b_ptr: column panel packed by pack_b, k rows
+// - both panels are zero padded, only the store is masked
+template <int tile_height, int tile_width>
+static inline void mm_tile_f64_kernel(const double* __restrict a_ptr,
+                                      const double* __restrict b_ptr,
+                                      double* __restrict c_ptr, int n, int k,
+                                      int rows, int cols) {
+  // a: tile_height * 2; b: 2 * tile_width; c: tile_height * tile_width
+  float64x2_t tile_a[tile_height];
+  float64x2_t tile_b[2][tile_width / 2];
+  float64x2_t tile_c[tile_height][tile_width / 2];
+
+  // make sure all floating point numbers can be held in neon registers
+  const int total_size = sizeof(tile_a) + sizeof(tile_b) + sizeof(tile_c);
+  static_assert(total_size <= 32 * 16);
+  static_assert(tile_width % 2 == 0);
+
+  for (int h = 0; h < tile_height; ++h) {
+    for (int w = 0; w < tile_width / 2; ++w) tile_c[h][w] = vdupq_n_f64(0.);
+  }
+  // kk: iterate panel_a by 2 cols and panel_b by 2 rows (one vector)
+  const int k2 = k & ~1;
+  for (int kk = 0; kk < k2; kk += 2) {
+    for (int h = 0; h < tile_height; ++h) {
+      tile_a[h] = vld1q_f64(a_ptr + h * 2);
+    }
+    for (int i = 0; i < 2; ++i) {
+      for (int w = 0; w < tile_width / 2; ++w) {
+        tile_b[i][w] = vld1q_f64(b_ptr + i * tile_width + w * 2);
+      }
+    }
+    a_ptr += tile_height * 2;
+    b_ptr += 2 * tile_width;
+    for (int h = 0; h < tile_height; ++h) {
+      for (int w = 0; w < tile_width / 2; ++w) {
+        tile_c[h][w] = vfmaq_laneq_f64(tile_c[h][w], tile_b[0][w],
+                                       tile_a[h], 0);
+        tile_c[h][w] = vfmaq_laneq_f64(tile_c[h][w], tile_b[1][w],
+                                       tile_a[h], 1);
+      }
+    }
+  }
+  // k remainder: the last row of b against the first column of the step
+  if (k2 < k) {
+    for (int w = 0; w < tile_width / 2; ++w) {
+      tile_b[0][w] = vld1q_f64(b_ptr + w * 2);
+    }
+    for (int h = 0; h < tile_height; ++h) {
+      for (int w = 0; w < tile_width / 2; ++w) {
+        tile_c[h][w] = vfmaq_f64(tile_c[h][w], tile_b[0][w],
+                                 vdupq_n_f64(a_ptr[h * 2]));
+      }
+    }
+  }
+
+  for (int h = 0; h < rows; ++h) {
+    double line[tile_width];
+    double* c_row = cols == tile_width ? c_ptr + h * n : line;
+    for (int w = 0; w < tile_width / 2; ++w) {
+      vst1q_f64(c_row + w * 2, tile_c[h][w]);
+    }
+    if (cols < tile_width) {
+      std::memcpy(c_ptr + h * n, line, cols * sizeof(double));
+    }
+  }
+}
+
+// calculate one register tile of complex float c, re and im interleaved
+// - one float32x4_t holds 2 complex numbers, panels are packed as for
+//   double: a by pack_a 2 columns per step, b by pack_b
+// - armv8-a has no fcmla: the re and im parts of a multiply b into 2
+//   accumulators, combined once at the store,
+//   c = re(a) * b + [-1, 1] * swap(im(a) * b)
+template <int tile_height, int tile_width>
+static inline void mm_tile_c32_kernel(
+    const std::complex<float>* __restrict a_ptr,
+    const std::complex<float>* __restrict b_ptr,
+    std::complex<float>* __restrict c_ptr, int n, int k, int rows,
+    int cols) {
+  // a: tile_height * 2; b: 2 * tile_width; c: 2 * tile_height * tile_width
+  float32x4_t tile_a[tile_height];
+  float32x4_t tile_b[2][tile_width / 2];
+  float32x4_t tile_re[tile_height][tile_width / 2];
+  float32x4_t tile_im[tile_height][tile_width / 2];
+
+  // make sure all floating point numbers can be held in neon registers
+  const int total_size = sizeof(tile_a) + sizeof(tile_b) + sizeof(tile_re) +
+                         sizeof(tile_im);
+  static_assert(total_size <= 32 * 16);
+  static_assert(tile_width % 2 == 0);
+
+  for (int h = 0; h < tile_height; ++h) {
+    for (int w = 0; w < tile_width / 2; ++w) {
+      tile_re[h][w] = tile_im[h][w] = vdupq_n_f32(0.f);
+    }
+  }
+  const float* a_f = reinterpret_cast<const float*>(a_ptr);
+  const float* b_f = reinterpret_cast<const float*>(b_ptr);
+  const int k2 = k & ~1;
+  for (int kk = 0; kk < k2; kk += 2) {
+    for (int h = 0; h < tile_height; ++h) tile_a[h] = vld1q_f32(a_f + h * 4);
+    for (int i = 0; i < 2; ++i) {
+      for (int w = 0; w < tile_width / 2; ++w) {
+        tile_b[i][w] = vld1q_f32(b_f + i * tile_width * 2 + w * 4);
+      }
+    }
+    a_f += tile_height * 4;
+    b_f += 2 * tile_width * 2;
+    unroll<2>([&](auto i) {
+      constexpr int lane = decltype(i)::value * 2;
       for (int h = 0; h < tile_height; ++h) {
-        std::memcpy(c_ptr + h * n, tile_c[h], tile_width * sizeof(float));
+        for (int w = 0; w < tile_width / 2; ++w) {
+          tile_re[h][w] = vfmaq_laneq_f32(tile_re[h][w], tile_b[i][w],
+                                          tile_a[h], lane);
+          tile_im[h][w] = vfmaq_laneq_f32(tile_im[h][w], tile_b[i][w],
+                                          tile_a[h], lane + 1);
+        }
+      }
+    });
+  }
+  // k remainder: the last row of b against the first column of the step
+  if (k2 < k) {
+    for (int w = 0; w < tile_width / 2; ++w) {
+      tile_b[0][w] = vld1q_f32(b_f + w * 4);
+    }
+    for (int h = 0; h < tile_height; ++h) {
+      for (int w = 0; w < tile_width / 2; ++w) {
+        tile_re[h][w] = vfmaq_n_f32(tile_re[h][w], tile_b[0][w], a_f[h * 4]);
+        tile_im[h][w] = vfmaq_n_f32(tile_im[h][w], tile_b[0][w],
+                                    a_f[h * 4 + 1]);
+      }
+    }
+  }
+
+  const float sign_v[4] = {-1.f, 1.f, -1.f, 1.f};
+  const float32x4_t sign = vld1q_f32(sign_v);
+  for (int h = 0; h < rows; ++h) {
+    std::complex<float> line[tile_width];
+    std::complex<float>* c_row = cols == tile_width ? c_ptr + h * n : line;
+    for (int w = 0; w < tile_width / 2; ++w) {
+      const float32x4_t v =
+          vfmaq_f32(tile_re[h][w], vrev64q_f32(tile_im[h][w]), sign);
+      vst1q_f32(reinterpret_cast<float*>(c_row + w * 2), v);
+    }
+    if (cols < tile_width) {
+      std::memcpy(c_ptr + h * n, line, cols * sizeof(std::complex<float>));
+    }
+  }
+}
+
+// calculate c by tile as mm_tile with a and b packed, double or complex
+// float elements
+// - tile sizes are in elements, 8x4 and 4x8 of double take 28 of the 32
+//   neon registers, 4x4 of complex float 24
+template <typename T, int tile_height, int tile_width>
+static void mm_tile_wide(const T* __restrict a, const T* __restrict b,
+                         T* __restrict c, int m, int n, int k) {
+  static_assert(std::is_same_v<T, double> ||
+                std::is_same_v<T, std::complex<float>>);
+  // k of packed a is padded to one vector, m and n to tile size
+  constexpr int step = 16 / sizeof(T);
+  const int k_pad = (k + step - 1) / step * step;
+  const int m_pad = (m + tile_height - 1) / tile_height * tile_height;
+  const int n_pad = (n + tile_width - 1) / tile_width * tile_width;
+
+  // packing buffers from the thread local workspace, sizes in floats
+  constexpr size_t floats = sizeof(T) / sizeof(float);
+  const size_t a_size =
+      cache_lines(static_cast<size_t>(m_pad) * k_pad * floats);
+  float* ws = thread_workspace(a_size +
+                               static_cast<size_t>(k) * n_pad * floats);
+  T* a_tx = reinterpret_cast<T*>(ws);
+  T* b_tx = reinterpret_cast<T*>(ws + a_size);
+  pack_a<tile_height>(a, k, a_tx, m, k);
+  pack_b<tile_width>(b, n, b_tx, k, n);
+
+  for (int nn = 0; nn < n; nn += tile_width) {
+    const int cols = std::min(tile_width, n - nn);
+    for (int mm = 0; mm < m; mm += tile_height) {
+      const int rows = std::min(tile_height, m - mm);
+      const T* a_ptr = a_tx + static_cast<long>(mm) * k_pad;
+      const T* b_ptr = b_tx + static_cast<long>(nn) * k;
+      T* c_ptr = c + static_cast<long>(mm) * n + nn;
+      if constexpr (std::is_same_v<T, double>) {
+        mm_tile_f64_kernel<tile_height, tile_width>(a_ptr, b_ptr, c_ptr, n,
+                                                    k, rows, cols);
+      } else {
+        mm_tile_c32_kernel<tile_height, tile_width>(a_ptr, b_ptr, c_ptr, n,
+                                                    k, rows, cols);
+      }
+    }
+  }
+}
+
+// y = alpha * sum + beta * y, y is not read if beta == 0, as the tile store
+static inline void gemv_store(float* y, float sum, float alpha, float beta) {
+  if (alpha != 1.f) sum *= alpha;
+  if (beta != 0.f) sum += beta * *y;
+  *y = sum;
+}
+
+// y[n] = alpha * x[k] * b[k][n] + beta * y[n], the m == 1 case, bound by
+// streaming b from memory
+// - b is read once, 4 rows at a time, y stays in L1 between the passes
+// - 16 wide blocks of y, 4 independent accumulators
+// - every element of y sums k in order, same result as the other kernels
+// - b rows are prefetched ahead with the streaming hint (prfm pldl1strm),
+//   b is not kept in cache
+// - alpha != 1 or beta != 0: the sums go to the thread local workspace
+//   first, then y is updated once
+static void gemv_xb(const float* __restrict x, const float* __restrict b,
+                    int ldb, float* __restrict c, int n, int k,
+                    float alpha, float beta) {
+  constexpr int prefetch = 256;  // floats ahead of the loads, per row of b
+  const bool scale = alpha != 1.f || beta != 0.f;
+  float* __restrict y = scale ? thread_workspace(n) : c;
+  std::memset(y, 0, n * sizeof(float));
+  int p = 0;
+  for (; p + 4 <= k; p += 4) {
+    const float* b0 = b + static_cast<long>(p) * ldb;
+    const float* b1 = b0 + ldb;
+    const float* b2 = b1 + ldb;
+    const float* b3 = b2 + ldb;
+    const float32x4_t xv = vld1q_f32(x + p);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+      __builtin_prefetch(b0 + j + prefetch, 0, 0);
+      __builtin_prefetch(b1 + j + prefetch, 0, 0);
+      __builtin_prefetch(b2 + j + prefetch, 0, 0);
+      __builtin_prefetch(b3 + j + prefetch, 0, 0);
+      float32x4_t y_vec[4];
+      for (int v = 0; v < 4; ++v) y_vec[v] = vld1q_f32(y + j + v * 4);
+      for (int v = 0; v < 4; ++v) {
+        y_vec[v] = vfmaq_laneq_f32(y_vec[v], vld1q_f32(b0 + j + v * 4), xv, 0);
+        y_vec[v] = vfmaq_laneq_f32(y_vec[v], vld1q_f32(b1 + j + v * 4), xv, 1);
+        y_vec[v] = vfmaq_laneq_f32(y_vec[v], vld1q_f32(b2 + j + v * 4), xv, 2);
+        y_vec[v] = vfmaq_laneq_f32(y_vec[v], vld1q_f32(b3 + j + v * 4), xv, 3);
       }
+      for (int v = 0; v < 4; ++v) vst1q_f32(y + j + v * 4, y_vec[v]);
+    }
+    for (; j + 4 <= n; j += 4) {
+      float32x4_t y_vec = vld1q_f32(y + j);
+      y_vec = vfmaq_laneq_f32(y_vec, vld1q_f32(b0 + j), xv, 0);
+      y_vec = vfmaq_laneq_f32(y_vec, vld1q_f32(b1 + j), xv, 1);
+      y_vec = vfmaq_laneq_f32(y_vec, vld1q_f32(b2 + j), xv, 2);
+      y_vec = vfmaq_laneq_f32(y_vec, vld1q_f32(b3 + j), xv, 3);
+      vst1q_f32(y + j, y_vec);
+    }
+    for (; j < n; ++j) {
+      y[j] += x[p] * b0[j];
+      y[j] += x[p + 1] * b1[j];
+      y[j] += x[p + 2] * b2[j];
+      y[j] += x[p + 3] * b3[j];
     }
   }
+  for (; p < k; ++p) {
+    const float* b0 = b + static_cast<long>(p) * ldb;
+    for (int j = 0; j < n; ++j) y[j] += x[p] * b0[j];
+  }
+  if (scale) {
+    for (int j = 0; j < n; ++j) gemv_store(c + j, y[j], alpha, beta);
+  }
+}
+
+// rows of y = alpha * a[rows][k] * x[k] + beta * y, groups * 4 rows, see
+// gemv_ax
+// - one accumulator per 4 row group, lane r sums row r
+// - 4x4 blocks of a are transposed to columns, so k is summed in order
+template <int groups>
+static inline void gemv_ax_rows(const float* __restrict a, int lda,
+                                const float* __restrict x,
+                                float* __restrict y, int incy, int k,
+                                float alpha, float beta) {
+  constexpr int prefetch = 256;  // floats ahead of the loads, per row of a
+  const float* rows[groups * 4];
+  for (int r = 0; r < groups * 4; ++r) rows[r] = a + static_cast<long>(r) * lda;
+  float32x4_t acc[groups];
+  for (int g = 0; g < groups; ++g) acc[g] = vdupq_n_f32(0.f);
 
-  delete[] a_tx;
-  delete[] b_tx;
+  int p = 0;
+  for (; p + 4 <= k; p += 4) {
+    const float32x4_t xv = vld1q_f32(x + p);
+    for (int g = 0; g < groups; ++g) {
+      const float* const* r = rows + g * 4;
+      if (p % 16 == 0) {
+        for (int i = 0; i < 4; ++i) {
+          __builtin_prefetch(r[i] + p + prefetch, 0, 0);
+        }
+      }
+      // t0 = r0[0] r1[0] r0[2] r1[2], t1 = r0[1] r1[1] r0[3] r1[3], ...
+      const float32x4_t r0 = vld1q_f32(r[0] + p), r1 = vld1q_f32(r[1] + p);
+      const float32x4_t r2 = vld1q_f32(r[2] + p), r3 = vld1q_f32(r[3] + p);
+      const float64x2_t t0 = vreinterpretq_f64_f32(vtrn1q_f32(r0, r1));
+      const float64x2_t t1 = vreinterpretq_f64_f32(vtrn2q_f32(r0, r1));
+      const float64x2_t t2 = vreinterpretq_f64_f32(vtrn1q_f32(r2, r3));
+      const float64x2_t t3 = vreinterpretq_f64_f32(vtrn2q_f32(r2, r3));
+      // column kk of the 4 rows
+      const float32x4_t c0 = vreinterpretq_f32_f64(vtrn1q_f64(t0, t2));
+      const float32x4_t c1 = vreinterpretq_f32_f64(vtrn1q_f64(t1, t3));
+      const float32x4_t c2 = vreinterpretq_f32_f64(vtrn2q_f64(t0, t2));
+      const float32x4_t c3 = vreinterpretq_f32_f64(vtrn2q_f64(t1, t3));
+      acc[g] = vfmaq_laneq_f32(acc[g], c0, xv, 0);
+      acc[g] = vfmaq_laneq_f32(acc[g], c1, xv, 1);
+      acc[g] = vfmaq_laneq_f32(acc[g], c2, xv, 2);
+      acc[g] = vfmaq_laneq_f32(acc[g], c3, xv, 3);
+    }
+  }
+  for (; p < k; ++p) {
+    for (int g = 0; g < groups; ++g) {
+      const float* const* r = rows + g * 4;
+      const float col[4] = {r[0][p], r[1][p], r[2][p], r[3][p]};
+      acc[g] = vfmaq_n_f32(acc[g], vld1q_f32(col), x[p]);
+    }
+  }
+
+  for (int g = 0; g < groups; ++g) {
+    float out[4];
+    vst1q_f32(out, acc[g]);
+    for (int i = 0; i < 4; ++i) {
+      gemv_store(y + (g * 4 + i) * incy, out[i], alpha, beta);
+    }
+  }
+}
+
+// y[m] = alpha * a[m][k] * x[k] + beta * y[m], the n == 1 case, bound by
+// streaming a from memory
+// - 16 rows of a at a time, 4 independent accumulators, then 4 rows, then
+//   the remaining rows one by one
+// - every element of y sums k in order, same result as the other kernels
+// - a rows are prefetched ahead with the streaming hint (prfm pldl1strm)
+// - incy: stride of y, e.g. the row stride of a column of c
+static void gemv_ax(const float* __restrict a, int lda,
+                    const float* __restrict x, float* __restrict y, int incy,
+                    int m, int k, float alpha, float beta) {
+  int i = 0;
+  for (; i + 16 <= m; i += 16) {
+    gemv_ax_rows<4>(a + static_cast<long>(i) * lda, lda, x, y + i * incy,
+                    incy, k, alpha, beta);
+  }
+  for (; i + 4 <= m; i += 4) {
+    gemv_ax_rows<1>(a + static_cast<long>(i) * lda, lda, x, y + i * incy,
+                    incy, k, alpha, beta);
+  }
+  for (; i < m; ++i) {
+    const float* row = a + static_cast<long>(i) * lda;
+    float sum = 0.f;
+    for (int p = 0; p < k; ++p) sum += row[p] * x[p];
+    gemv_store(y + i * incy, sum, alpha, beta);
+  }
+}
+
+// gotoblas style cache blocking around the register tile
+// - k is split into kc blocks, c accumulates across them
+// - kc * nc block of b is packed once and shared by all row blocks (L3)
+// - mc * kc block of a is packed and reused by all column panels (L2)
+// - tile_height * kc panel of a, kc * tile_width panel of b stay in L1
+// - blas semantics: c = alpha * op(a) * op(b) + beta * c, row major,
+//   op(x) is x or its transpose, lda/ldb/ldc are the row strides
+// - b_packed: b already packed by pack_b_blocked, b and ldb are ignored
+// - ws: mc * kc + kc * nc floats for the packing buffers, 64 byte aligned,
+//   the thread local workspace if nullptr
+template <int tile_height, int tile_width, int mc, int kc, int nc,
+          bool trans_a, bool trans_b>
+static void gemm_blocked(int m, int n, int k, float alpha,
+                         const float* __restrict a, int lda,
+                         const float* __restrict b, int ldb, float beta,
+                         float* __restrict c, int ldc,
+                         const float* __restrict b_packed = nullptr,
+                         float* __restrict ws = nullptr) {
+  static_assert(mc % tile_height == 0 && nc % tile_width == 0 && kc % 4 == 0);
+
+  if (k == 0 || alpha == 0.f) {
+    for (int row = 0; row < m; ++row) {
+      float* c_ptr = c + row * ldc;
+      for (int col = 0; col < n; ++col) {
+        c_ptr[col] = beta == 0.f ? 0.f : beta * c_ptr[col];
+      }
+    }
+    return;
+  }
+
+  // matrix vector products are bound by reading the matrix once, no packing
+  // - only when the vector operand is contiguous, any alpha and beta
+  if (!b_packed) {
+    if (m == 1 && (!trans_a || lda == 1) && !trans_b) {
+      return gemv_xb(a, b, ldb, c, n, k, alpha, beta);
+    }
+    if (n == 1 && !trans_a && (trans_b || ldb == 1)) {
+      return gemv_ax(a, lda, b, c, ldc, m, k, alpha, beta);
+    }
+  }
+
+  static_assert(mc * kc % 16 == 0);
+  if (!ws) ws = thread_workspace(mc * kc + (b_packed ? 0 : kc * nc));
+  float* a_pack = ws;
+  float* b_pack = ws + mc * kc;
+
+  // jc: start column of c's column block
+  for (int jc = 0; jc < n; jc += nc) {
+    const int nc_cur = std::min(nc, n - jc);
+    const int nc_pad = (nc_cur + tile_width - 1) / tile_width * tile_width;
+    // pc: start of the k block
+    for (int pc = 0; pc < k; pc += kc) {
+      const int kc_cur = std::min(kc, k - pc);
+      const int kc_pad = (kc_cur + 3) & ~3;
+      // c is scaled by beta once, later k blocks add on top of it
+      // - alpha == 1: continue the sum in registers, same result as unsplit k
+      // - otherwise: c += alpha * tile_c
+      const bool first = pc == 0;
+      const bool accumulate = !first && alpha == 1.f;
+      const float beta_cur = first ? beta : (accumulate ? 0.f : 1.f);
+      const float* b_cur;
+      if (b_packed) {
+        b_cur = b_packed + static_cast<long>(jc) * k + pc * nc_pad;
+      } else {
+        pack_b<tile_width, trans_b>(
+            trans_b ? (b + jc * ldb + pc) : (b + pc * ldb + jc), ldb,
+            b_pack, kc_cur, nc_cur);
+        b_cur = b_pack;
+      }
+      // ic: start row of c's row block
+      for (int ic = 0; ic < m; ic += mc) {
+        const int mc_cur = std::min(mc, m - ic);
+        pack_a<tile_height, trans_a>(
+            trans_a ? (a + pc * lda + ic) : (a + ic * lda + pc), lda,
+            a_pack, mc_cur, kc_cur);
+        // jr, ir: register tile inside the block
+        for (int jr = 0; jr < nc_cur; jr += tile_width) {
+          const int cols = std::min(tile_width, nc_cur - jr);
+          for (int ir = 0; ir < mc_cur; ir += tile_height) {
+            const int rows = std::min(tile_height, mc_cur - ir);
+            mm_tile_kernel<tile_height, tile_width, true, true>(
+                a_pack + ir * kc_pad, b_cur + jr * kc_cur,
+                c + (ic + ir) * ldc + jc + jr, ldc, kc_cur, rows, cols,
+                accumulate, alpha, beta_cur);
+          }
+        }
+      }
+    }
+  }
+}
+
+// pack op(b) of k * n once in the order gemm_blocked consumes it
+// - kc * nc blocks, k blocks of one column block are contiguous
+// - each block is pack_b panels, zero padded to tile_width columns
+// - b_tx: k * n_pad floats, block [jc][pc] starts at jc * k + pc * nc_pad
+template <int tile_width, int kc, int nc, bool trans_b>
+static void pack_b_blocked(const float* __restrict b, int ldb,
+                           float* __restrict b_tx, int k, int n) {
+  for (int jc = 0; jc < n; jc += nc) {
+    const int nc_cur = std::min(nc, n - jc);
+    const int nc_pad = (nc_cur + tile_width - 1) / tile_width * tile_width;
+    for (int pc = 0; pc < k; pc += kc) {
+      pack_b<tile_width, trans_b>(
+          trans_b ? (b + jc * ldb + pc) : (b + pc * ldb + jc), ldb,
+          b_tx + static_cast<long>(jc) * k + pc * nc_pad,
+          std::min(kc, k - pc), nc_cur);
+    }
+  }
+}
+
+// cache blocked c = a * b, dense row major
+template <int tile_height = 8, int tile_width = 8,
+          int mc = 128, int kc = 256, int nc = 4096>
+static void mm_blocked(const float* __restrict a, const float* __restrict b,
+                       float* __restrict c, int m, int n, int k) {
+  gemm_blocked<tile_height, tile_width, mc, kc, nc, false, false>(
+      m, n, k, 1.f, a, k, b, n, 0.f, c, n);
+}
+
+// register tile and cache blocks of the blas style entry points
+constexpr int th = 8, tw = 8, mc = 128, kc = 256, nc = 4096;
+// L1D of neoverse n1/n2
+constexpr long l1_bytes = 64 * 1024;
+
+size_t sgemm_workspace_size() {
+  return (mc * kc + kc * nc) * sizeof(float);
+}
+
+// blas style entry point, see gemm_blocked
+void sgemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+           const float* a, int lda, const float* b, int ldb, float beta,
+           float* c, int ldc) {
+  sgemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+        nullptr);
+}
+
+void sgemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+           const float* a, int lda, const float* b, int ldb, float beta,
+           float* c, int ldc, void* workspace) {
+  float* ws = static_cast<float*>(workspace);
+  if (trans_a) {
+    if (trans_b) {
+      gemm_blocked<th, tw, mc, kc, nc, true, true>(
+          m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, nullptr, ws);
+    } else {
+      gemm_blocked<th, tw, mc, kc, nc, true, false>(
+          m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, nullptr, ws);
+    }
+  } else {
+    if (trans_b) {
+      gemm_blocked<th, tw, mc, kc, nc, false, true>(
+          m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, nullptr, ws);
+    } else {
+      gemm_blocked<th, tw, mc, kc, nc, false, false>(
+          m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, nullptr, ws);
+    }
+  }
+}
+
+struct sgemm_packed_b {
+  int k, n;
+  std::vector<float> data;
+};
+
+// packed b of every (b, trans_b, k, n, ldb) packed so far
+using packed_b_key = std::tuple<const float*, bool, int, int, int>;
+static std::map<packed_b_key, std::unique_ptr<sgemm_packed_b>> packed_bs;
+static std::mutex packed_bs_mutex;
+
+const sgemm_packed_b* sgemm_pack_b(bool trans_b, int k, int n,
+                                   const float* b, int ldb) {
+  std::lock_guard<std::mutex> lock(packed_bs_mutex);
+  auto& packed = packed_bs[{b, trans_b, k, n, ldb}];
+  if (packed) return packed.get();
+
+  const int n_pad = (n + tw - 1) / tw * tw;
+  packed.reset(new sgemm_packed_b{k, n, std::vector<float>(
+      static_cast<long>(k) * n_pad)});
+  if (trans_b) {
+    pack_b_blocked<tw, kc, nc, true>(b, ldb, packed->data.data(), k, n);
+  } else {
+    pack_b_blocked<tw, kc, nc, false>(b, ldb, packed->data.data(), k, n);
+  }
+  return packed.get();
+}
+
+void sgemm_unpack_b(const float* b) {
+  std::lock_guard<std::mutex> lock(packed_bs_mutex);
+  if (!b) {
+    packed_bs.clear();
+    return;
+  }
+  auto it = packed_bs.lower_bound({b, false, 0, 0, 0});
+  while (it != packed_bs.end() && std::get<0>(it->first) == b) {
+    it = packed_bs.erase(it);
+  }
+}
+
+// sgemm with op(b) packed beforehand, no packing of b at all
+void sgemm_packed(bool trans_a, int m, float alpha, const float* a, int lda,
+                  const sgemm_packed_b* b, float beta, float* c, int ldc) {
+  if (trans_a) {
+    gemm_blocked<th, tw, mc, kc, nc, true, false>(
+        m, b->n, b->k, alpha, a, lda, nullptr, 0, beta, c, ldc,
+        b->data.data());
+  } else {
+    gemm_blocked<th, tw, mc, kc, nc, false, false>(
+        m, b->n, b->k, alpha, a, lda, nullptr, 0, beta, c, ldc,
+        b->data.data());
+  }
+}
+
+// cache blocked c = a * b with b packed once per b and shape, the packs are
+// dropped by sgemm_unpack_b
+static void mm_blocked_prepacked(const float* __restrict a,
+                                 const float* __restrict b,
+                                 float* __restrict c, int m, int n, int k) {
+  sgemm_packed(false, m, 1.f, a, k, sgemm_pack_b(false, k, n, b, n), 0.f,
+               c, n);
+}
+
+// batched c = a * b, see mm.h
+// - broadcast b with a and c stacked without gaps: one gemm of batch * m
+//   rows, register tiles span the matrix boundaries, so small m still fills
+//   the micro kernel
+// - other broadcast b: packed once into the workspace, every matrix runs
+//   gemm_blocked on the shared pack
+// - b per matrix: matrices whose b fits in a quarter of L1 skip packing
+//   (mm_tile on the unpacked data, a rows and c tiles take the rest), larger
+//   ones run gemm_blocked, all share one workspace
+void mm_batched(int batch, int m, int n, int k, const float* a, long stride_a,
+                const float* b, long stride_b, float* c, long stride_c) {
+  if (batch <= 0) return;
+  const long mk = static_cast<long>(m) * k, mn = static_cast<long>(m) * n;
+  if (stride_b == 0) {
+    if (stride_a == mk && stride_c == mn) {
+      gemm_blocked<th, tw, mc, kc, nc, false, false>(
+          batch * m, n, k, 1.f, a, k, b, n, 0.f, c, n);
+      return;
+    }
+    const int n_pad = (n + tw - 1) / tw * tw;
+    const size_t b_size = cache_lines(static_cast<size_t>(k) * n_pad);
+    float* ws = thread_workspace(b_size + mc * kc);
+    pack_b_blocked<tw, kc, nc, false>(b, n, ws, k, n);
+    for (long i = 0; i < batch; ++i) {
+      gemm_blocked<th, tw, mc, kc, nc, false, false>(
+          m, n, k, 1.f, a + i * stride_a, k, nullptr, n, 0.f,
+          c + i * stride_c, n, ws, ws + b_size);
+    }
+    return;
+  }
+
+  constexpr long small_b = l1_bytes / 4 / sizeof(float);  // floats, 16K
+  for (long i = 0; i < batch; ++i) {
+    const float* a_i = a + i * stride_a;
+    const float* b_i = b + i * stride_b;
+    float* c_i = c + i * stride_c;
+    if (static_cast<long>(k) * n <= small_b) {
+      mm_tile<th, tw, false, false>(a_i, b_i, c_i, m, n, k);
+    } else {
+      gemm_blocked<th, tw, mc, kc, nc, false, false>(
+          m, n, k, 1.f, a_i, k, b_i, n, 0.f, c_i, n);
+    }
+  }
+}
+
+// grouped c = a * b, see mm.h
+// - a block of c is mc rows by 2 * mc columns, gemm_blocked on the block
+//   packs its own panels of a and b into the thread local workspace
+// - packing per block costs 1 / block_n (a) and 1 / block_m (b) of its
+//   multiply-adds
+void mm_grouped(int count, const mm_problem* problems, ThreadPool* pool) {
+  constexpr int block_m = mc, block_n = 2 * mc;
+  // first block of each problem, blocks run row major inside a problem
+  std::vector<long> first(count + 1, 0);
+  for (int i = 0; i < count; ++i) {
+    const mm_problem& p = problems[i];
+    const long rows = (p.m + block_m - 1) / block_m;
+    const long cols = (p.n + block_n - 1) / block_n;
+    first[i + 1] = first[i] + rows * cols;
+  }
+
+  std::atomic<long> next{0};
+  auto worker = [&] {
+    for (long block; (block = next.fetch_add(1)) < first[count];) {
+      const int i = std::upper_bound(first.begin(), first.end(), block) -
+                    first.begin() - 1;
+      const mm_problem& p = problems[i];
+      const long cols = (p.n + block_n - 1) / block_n;
+      const int row = (block - first[i]) / cols * block_m;
+      const int col = (block - first[i]) % cols * block_n;
+      gemm_blocked<th, tw, mc, kc, nc, false, false>(
+          std::min(block_m, p.m - row), std::min(block_n, p.n - col), p.k,
+          1.f, p.a + static_cast<long>(row) * p.k, p.k, p.b + col, p.n, 0.f,
+          p.c + static_cast<long>(row) * p.n + col, p.n);
+    }
+  };
+  if (pool) {
+    pool->run([&](int) { worker(); });
+  } else {
+    worker();
+  }
+}
+
+// mm_tile with the epilogue picked by which of bias and residual are given
+template <Activation act>
+static void mm_tile_8x8_epilogue(const float* a, const float* b, float* c,
+                                 int m, int n, int k, const float* bias,
+                                 const float* residual) {
+  if (bias && residual) {
+    mm_tile_fused<8, 8, false, false, true, act, true>(
+        a, b, c, m, n, k, bias, residual);
+  } else if (bias) {
+    mm_tile_fused<8, 8, false, false, true, act, false>(
+        a, b, c, m, n, k, bias, residual);
+  } else if (residual) {
+    mm_tile_fused<8, 8, false, false, false, act, true>(
+        a, b, c, m, n, k, bias, residual);
+  } else {
+    mm_tile_fused<8, 8, false, false, false, act, false>(
+        a, b, c, m, n, k, bias, residual);
+  }
 }
 
 extern "C" {
 void mm_panel_24_asm(const float*, const float*, float*, int, int, int);
 void mm_tile_8x8_asm(const float*, const float*, float*, int, int, int);
+
+// mm_panel_24_asm and mm_tile_8x8_asm with software prefetch, dist: prefetch
+// distance in k steps
+void mm_panel_24_pf_asm(const float*, const float*, float*, int, int, int,
+                        int dist);
+void mm_tile_8x8_pf_asm(const float*, const float*, float*, int, int, int,
+                        int dist);
+
+// mm_tile_8x8_asm with the epilogue fused: c = act(a * b + bias) + residual,
+// bias or residual is skipped if nullptr
+void mm_tile_8x8_epi_asm(const float*, const float*, float*, int, int, int,
+                         const float*, const float*);
+void mm_tile_8x8_epi_relu_asm(const float*, const float*, float*, int, int,
+                              int, const float*, const float*);
+void mm_tile_8x8_epi_gelu_asm(const float*, const float*, float*, int, int,
+                              int, const float*, const float*);
+
+// generated by mm-ukr-gen.cc
+void mm_ukr_8x8_asm(const float*, const float*, float*, long, long);
+void mm_ukr_12x8_asm(const float*, const float*, float*, long, long);
+void mm_ukr_8x12_asm(const float*, const float*, float*, long, long);
+void mm_ukr_16x4_asm(const float*, const float*, float*, long, long);
+void mm_ukr_4x16_asm(const float*, const float*, float*, long, long);
+
+// asm kernels branch here if the matrix is narrower than one register tile
+void mm_panel_24_small(const float* a, const float* b, float* c,
+                       int m, int n, int k) {
+  mm_panel<24>(a, b, c, m, n, k);
+}
+void mm_tile_8x8_small(const float* a, const float* b, float* c,
+                       int m, int n, int k) {
+  mm_tile<8, 8, false, false>(a, b, c, m, n, k);
+}
+void mm_tile_8x8_epi_small(const float* a, const float* b, float* c,
+                           int m, int n, int k, const float* bias,
+                           const float* residual) {
+  mm_tile_8x8_epilogue<Activation::none>(a, b, c, m, n, k, bias, residual);
+}
+void mm_tile_8x8_epi_relu_small(const float* a, const float* b, float* c,
+                                int m, int n, int k, const float* bias,
+                                const float* residual) {
+  mm_tile_8x8_epilogue<Activation::relu>(a, b, c, m, n, k, bias, residual);
+}
+void mm_tile_8x8_epi_gelu_small(const float* a, const float* b, float* c,
+                                int m, int n, int k, const float* bias,
+                                const float* residual) {
+  mm_tile_8x8_epilogue<Activation::gelu>(a, b, c, m, n, k, bias, residual);
+}
+}
+
+using epilogue_func = void(*)(const float*, const float*, float*, int, int,
+                              int, const float*, const float*);
+
+// fused asm kernel with bias and residual enabled at compile time, the same
+// meaning as mm_tile_fused
+template <epilogue_func kernel, bool has_bias, bool has_residual>
+static void mm_tile_8x8_fused_asm(const float* a, const float* b, float* c,
+                                  int m, int n, int k, const float* bias,
+                                  const float* residual) {
+  kernel(a, b, c, m, n, k, has_bias ? bias : nullptr,
+         has_residual ? residual : nullptr);
+}
+
+// one separate elementwise pass of an epilogue over c of m x n, reads and
+// writes all of c: the unfused counterpart of mm_tile_fused
+template <bool has_bias, Activation act, bool has_residual>
+static void epilogue_pass(float* c, int m, int n, const float* bias,
+                          const float* residual) {
+  const Epilogue<has_bias, act, has_residual> epilogue{bias, residual, n};
+  for (int row = 0; row < m; ++row) {
+    float* c_ptr = c + static_cast<long>(row) * n;
+    for (int col = 0; col < n; col += 4) {
+      const int cols = std::min(4, n - col);
+      float32x4_t v = vdupq_n_f32(0.f);
+      std::memcpy(&v, c_ptr + col, cols * sizeof(float));
+      v = epilogue.offset(row, col).apply(v, 0, 0, cols);
+      std::memcpy(c_ptr + col, &v, cols * sizeof(float));
+    }
+  }
+}
+
+using ukr_func = void(*)(const float*, const float*, float*, long, long);
+
+// calculate c by a generated asm micro kernel, one call per register tile
+// - a packed by pack_a_cols, b by pack_b, both padded to full tiles
+// - edge tiles are calculated into a local tile, the valid part is copied
+template <int tile_height, int tile_width, ukr_func ukr>
+static void mm_ukr(const float* __restrict a, const float* __restrict b,
+                   float* __restrict c, int m, int n, int k) {
+  const int m_pad = (m + tile_height - 1) / tile_height * tile_height;
+  const int n_pad = (n + tile_width - 1) / tile_width * tile_width;
+  const size_t a_size = cache_lines(static_cast<size_t>(m_pad) * k);
+  float* a_tx = thread_workspace(a_size + static_cast<size_t>(k) * n_pad);
+  float* b_tx = a_tx + a_size;
+  pack_a_cols<tile_height>(a, k, a_tx, m, k);
+  pack_b<tile_width>(b, n, b_tx, k, n);
+
+  alignas(64) float edge[tile_height * tile_width];
+  for (int nn = 0; nn < n; nn += tile_width) {
+    const int cols = std::min(tile_width, n - nn);
+    for (int mm = 0; mm < m; mm += tile_height) {
+      const int rows = std::min(tile_height, m - mm);
+      const float* a_ptr = a_tx + mm * k;
+      const float* b_ptr = b_tx + nn * k;
+      float* c_ptr = c + mm * n + nn;
+      if (rows == tile_height && cols == tile_width) {
+        ukr(a_ptr, b_ptr, c_ptr, n, k);
+      } else {
+        ukr(a_ptr, b_ptr, edge, tile_width, k);
+        for (int h = 0; h < rows; ++h) {
+          std::memcpy(c_ptr + h * n, edge + h * tile_width,
+                      cols * sizeof(float));
+        }
+      }
+    }
+  }
+}
+
+using jit_func = void(*)(const float* a_tx, const float* b_tx, float* c);
+
+// jit compile the full 8x8 tiles of c = a * b for one shape
+// - a_tx packed by pack_a_cols, b_tx by pack_b, m and n multiples of 8
+// - every stride and panel size is an immediate, no k/n registers
+// - k loop fully unrolled up to 64, else unrolled by 8 plus the remainder
+// - a_tx walks through the row panels, b_tx is reset per tile
+// - tile_a: v0 v1, tile_b: v2 v3, tile_c: v16 ~ v31, nothing callee saved
+static jit_func jit_mm_tile_8x8(int m, int n, int k) {
+  enum { a = 0, b = 1, c = 2, b_col = 3, c_col = 4, nn = 5, a_ptr = 6,
+         c_ptr = 7, mm = 8, b_ptr = 9, kk = 10, tmp = 11 };
+  const long row_bytes = n * 4L;
+  // c rows as immediate offsets: str q [c_ptr, #h * n * 4 + 16]
+  const bool c_imm = n % 4 == 0 && 7 * row_bytes + 16 <= 65520;
+
+  Assembler as;
+  auto k_step = [&as] {
+    as.ldp_q_post(0, 1, a_ptr, 32);
+    as.ldp_q_post(2, 3, b_ptr, 32);
+    for (int h = 0; h < 8; ++h) {
+      as.fmla(16 + h * 2, 2, h / 4, h % 4);
+      as.fmla(17 + h * 2, 3, h / 4, h % 4);
+    }
+  };
+
+  as.mov(b_col, b);
+  as.mov(c_col, c);
+  as.mov_imm(nn, n / 8);
+  const size_t col_loop = as.pos();
+  as.mov(a_ptr, a);
+  as.mov(c_ptr, c_col);
+  as.mov_imm(mm, m / 8);
+  const size_t row_loop = as.pos();
+  as.mov(b_ptr, b_col);
+  for (int v = 16; v < 32; ++v) as.movi_zero(v);
+
+  constexpr int unroll = 8, max_unroll = 64;
+  int k_rest = k;
+  if (k > max_unroll) {
+    as.mov_imm(kk, k / unroll);
+    const size_t k_loop = as.pos();
+    for (int i = 0; i < unroll; ++i) k_step();
+    as.subs_imm(kk, kk, 1);
+    as.b_ne(k_loop);
+    k_rest = k % unroll;
+  }
+  for (int i = 0; i < k_rest; ++i) k_step();
+
+  if (c_imm) {
+    as.stp_q(16, 17, c_ptr, 0);
+    for (int h = 1; h < 8; ++h) {
+      as.str_q(16 + h * 2, c_ptr, h * row_bytes);
+      as.str_q(17 + h * 2, c_ptr, h * row_bytes + 16);
+    }
+  } else {
+    as.mov(tmp, c_ptr);
+    for (int h = 0; h < 8; ++h) {
+      as.stp_q(16 + h * 2, 17 + h * 2, tmp, 0);
+      if (h < 7) as.add_imm(tmp, tmp, row_bytes);
+    }
+  }
+  as.add_imm(c_ptr, c_ptr, 8 * row_bytes);
+  as.subs_imm(mm, mm, 1);
+  as.b_ne(row_loop);
+
+  as.add_imm(b_col, b_col, 8 * 4L * k);
+  as.add_imm(c_col, c_col, 8 * 4);
+  as.subs_imm(nn, nn, 1);
+  as.b_ne(col_loop);
+  as.ret();
+
+  return reinterpret_cast<jit_func>(as.finalize());
+}
+
+// jit kernel of one shape, compiled by the first call of the shape
+// - a published map is never changed, so it is read without a lock; a new
+//   shape is compiled under kernels_mutex into an updated copy, the old
+//   maps are kept alive for callers still reading them
+// - the kernel of the last shape is kept per thread, repeated calls of one
+//   shape skip the map; a compiled kernel is never replaced, so the key
+//   alone tells if it is still valid
+// - nullptr if the kernel cannot be mapped executable
+using jit_key = std::tuple<int, int, int>;
+using jit_map = std::map<jit_key, jit_func>;
+
+static jit_func jit_kernel(int m, int n, int k) {
+  static const jit_map empty;
+  static std::atomic<const jit_map*> kernels{&empty};
+  static std::mutex kernels_mutex;
+  static std::vector<std::unique_ptr<const jit_map>> published;
+
+  thread_local struct {
+    jit_key key;
+    jit_func func;
+  } last{};
+  const jit_key key{m, n, k};
+  if (last.key == key) return last.func;
+
+  const jit_map* current = kernels.load(std::memory_order_acquire);
+  auto it = current->find(key);
+  if (it == current->end()) {
+    std::lock_guard<std::mutex> lock(kernels_mutex);
+    current = kernels.load(std::memory_order_relaxed);
+    it = current->find(key);
+    if (it == current->end()) {
+      auto updated = std::make_unique<jit_map>(*current);
+      it = updated->emplace(key, jit_mm_tile_8x8(m / 8 * 8, n, k)).first;
+      kernels.store(updated.get(), std::memory_order_release);
+      published.push_back(std::move(updated));
+    }
+  }
+  last = {key, it->second};
+  return last.func;
+}
+
+// c = a * b by a kernel jit compiled for the shape, see jit_kernel
+// - full tiles by the jit kernel, the right and bottom edges by mm_tile_edge
+// - falls back to mm_tile if the kernel cannot be mapped executable
+static void mm_jit_8x8(const float* __restrict a, const float* __restrict b,
+                       float* __restrict c, int m, int n, int k) {
+  const int m8 = m / 8 * 8, n8 = n / 8 * 8;
+  if (m8 && n8) {
+    const jit_func func = jit_kernel(m, n, k);
+    if (!func) return mm_tile<8, 8, true, true>(a, b, c, m, n, k);
+
+    const size_t a_size = cache_lines(static_cast<size_t>(m8) * k);
+    float* a_tx = thread_workspace(a_size + static_cast<size_t>(k) * n8);
+    float* b_tx = a_tx + a_size;
+    pack_a_cols<8>(a, k, a_tx, m8, k);
+    pack_b<8>(b, n, b_tx, k, n8);
+    func(a_tx, b_tx, c);
+  }
+
+  // right edge of all rows, bottom edge of the full columns
+  for (int mm = 0; n8 < n && mm < m; mm += 8) {
+    mm_tile_edge<8, 8, false, false>(a + mm * k, b + n8, c + mm * n + n8,
+                                     n, k, std::min(8, m - mm), n - n8);
+  }
+  for (int nn = 0; m8 < m && nn < n8; nn += 8) {
+    mm_tile_edge<8, 8, false, false>(a + m8 * k, b + nn, c + m8 * n + nn,
+                                     n, k, m - m8, 8);
+  }
+}
+
+using mm_func = void(*)(const float*, const float*, float*, int, int, int);
+
+// every kernel variant the autotuner chooses from, all support any shape
+// - tile sizes: all combinations fitting the 32 neon registers
+// - packing: -T packs both a and b, -Tb packs b only
+// - blocked: tile sizes dividing the mc/nc cache blocks
+static const struct {
+  const char* name;
+  mm_func func;
+} tune_candidates[] {
+  {"panel-24",          mm_panel<24>                    },
+  {"panel-24-asm",      mm_panel_24_asm                 },
+  {"tile-8x8-asm",      mm_tile_8x8_asm                 },
+  {"jit-8x8",           mm_jit_8x8                      },
+  {"ukr-8x8-asm",       mm_ukr<8, 8, mm_ukr_8x8_asm>    },
+  {"ukr-12x8-asm",      mm_ukr<12, 8, mm_ukr_12x8_asm>  },
+  {"ukr-8x12-asm",      mm_ukr<8, 12, mm_ukr_8x12_asm>  },
+  {"ukr-16x4-asm",      mm_ukr<16, 4, mm_ukr_16x4_asm>  },
+  {"ukr-4x16-asm",      mm_ukr<4, 16, mm_ukr_4x16_asm>  },
+  {"tile-8x8",          mm_tile<8, 8, false, false>     },
+  {"tile-8x8-Tb",       mm_tile<8, 8, false, true>      },
+  {"tile-8x8-T",        mm_tile<8, 8, true, true>       },
+  {"tile-4x12",         mm_tile<4, 12, false, false>    },
+  {"tile-4x12-Tb",      mm_tile<4, 12, false, true>     },
+  {"tile-4x12-T",       mm_tile<4, 12, true, true>      },
+  {"tile-12x4",         mm_tile<12, 4, false, false>    },
+  {"tile-12x4-Tb",      mm_tile<12, 4, false, true>     },
+  {"tile-12x4-T",       mm_tile<12, 4, true, true>      },
+  {"tile-8x4",          mm_tile<8, 4, false, false>     },
+  {"tile-8x4-Tb",       mm_tile<8, 4, false, true>      },
+  {"tile-8x4-T",        mm_tile<8, 4, true, true>       },
+  {"tile-4x8",          mm_tile<4, 8, false, false>     },
+  {"tile-4x8-Tb",       mm_tile<4, 8, false, true>      },
+  {"tile-4x8-T",        mm_tile<4, 8, true, true>       },
+  {"blocked-8x8",       mm_blocked<8, 8>                },
+  {"blocked-8x4",       mm_blocked<8, 4>                },
+  {"blocked-4x8",       mm_blocked<4, 8>                },
+};
+
+// kernel of every tuned shape, loaded from the tuning cache file once
+// - file: env MM_TUNE_CACHE or mm-tune.cache, one "m n k name" per line,
+//   appended by mm_autotune, later lines override earlier ones
+// - a published map is never changed, so mm_tuned reads it without a lock;
+//   mm_autotune publishes an updated copy under tuned_mutex and keeps the
+//   old ones alive for callers still reading them
+using tune_key = std::tuple<int, int, int>;
+using tune_map = std::map<tune_key, mm_func>;
+static std::mutex tuned_mutex;
+
+static const char* tune_cache_path() {
+  const char* path = std::getenv("MM_TUNE_CACHE");
+  return path ? path : "mm-tune.cache";
+}
+
+static std::atomic<const tune_map*>& tuned_kernels() {
+  static const tune_map loaded = [] {
+    tune_map loaded;
+    std::ifstream file(tune_cache_path());
+    int m, n, k;
+    std::string name;
+    while (file >> m >> n >> k >> name) {
+      for (const auto& candidate : tune_candidates) {
+        if (name == candidate.name) loaded[{m, n, k}] = candidate.func;
+      }
+    }
+    return loaded;
+  }();
+  static std::atomic<const tune_map*> kernels{&loaded};
+  return kernels;
+}
+
+const char* mm_autotune(int m, int n, int k, bool verbose) {
+  std::vector<float> a(static_cast<long>(m) * k);
+  std::vector<float> b(static_cast<long>(k) * n);
+  std::vector<float> c(static_cast<long>(m) * n);
+  for (size_t i = 0; i < a.size(); ++i) a[i] = static_cast<float>(i % 7);
+  for (size_t i = 0; i < b.size(); ++i) b[i] = static_cast<float>(i % 5);
+
+  // best of at least 3 runs and 50ms per kernel, after one warmup run
+  using clock = std::chrono::steady_clock;
+  int best = 0;
+  double best_time = 1e30;
+  const int n_candidates =
+      sizeof(tune_candidates) / sizeof(tune_candidates[0]);
+  for (int i = 0; i < n_candidates; ++i) {
+    const mm_func func = tune_candidates[i].func;
+    func(a.data(), b.data(), c.data(), m, n, k);
+    double time = 1e30, total = 0;
+    for (int run = 0; run < 3 || total < 0.05; ++run) {
+      const auto start = clock::now();
+      func(a.data(), b.data(), c.data(), m, n, k);
+      const double t = std::chrono::duration<double>(clock::now() - start)
+                       .count();
+      time = std::min(time, t);
+      total += t;
+    }
+    if (verbose) {
+      std::cout << tune_candidates[i].name << ": " << time * 1e3 << " ms\n";
+    }
+    if (time < best_time) {
+      best = i;
+      best_time = time;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(tuned_mutex);
+  static std::vector<std::unique_ptr<const tune_map>> published;
+  auto& kernels = tuned_kernels();
+  auto updated =
+      std::make_unique<tune_map>(*kernels.load(std::memory_order_relaxed));
+  (*updated)[{m, n, k}] = tune_candidates[best].func;
+  kernels.store(updated.get(), std::memory_order_release);
+  published.push_back(std::move(updated));
+  std::ofstream(tune_cache_path(), std::ios::app) \
+      << m << ' ' << n << ' ' << k << ' ' << tune_candidates[best].name \
+      << '\n';
+  return tune_candidates[best].name;
+}
+
+// the kernel of the last shape is kept per thread, repeated calls of one
+// shape skip the map lookup until mm_autotune publishes a new map
+void mm_tuned(const float* a, const float* b, float* c, int m, int n, int k) {
+  thread_local struct {
+    const tune_map* kernels;
+    tune_key key;
+    mm_func func;
+  } last{};
+  const tune_map* kernels = tuned_kernels().load(std::memory_order_acquire);
+  const tune_key key{m, n, k};
+  if (last.kernels != kernels || last.key != key) {
+    const auto it = kernels->find(key);
+    last = {kernels, key,
+            it != kernels->end() ? it->second : mm_blocked<8, 8>};
+  }
+  last.func(a, b, c, m, n, k);
 }
 
-auto _mm_baseline = mm_baseline;
+auto _mm_baseline = mm_baseline<float>;
 auto _mm_panel_24 = mm_panel<24>;
 auto _mm_panel_24_asm = mm_panel_24_asm;
 auto _mm_tile_8x8 = mm_tile<8, 8, false, false>;
 auto _mm_tile_8x8_asm = mm_tile_8x8_asm;
+auto _mm_panel_24_pf_asm = mm_panel_24_pf_asm;
+auto _mm_tile_8x8_pf_asm = mm_tile_8x8_pf_asm;
 auto _mm_tile_8x8_T = mm_tile<8, 8, true, true>;
+auto _mm_tile_8x8_T_bias_relu =
+    mm_tile_fused<8, 8, true, true, true, Activation::relu, false>;
+auto _mm_tile_8x8_T_bias_gelu =
+    mm_tile_fused<8, 8, true, true, true, Activation::gelu, false>;
+auto _mm_tile_8x8_T_bias_residual =
+    mm_tile_fused<8, 8, true, true, true, Activation::none, true>;
+auto _mm_tile_8x8_asm_bias_relu =
+    mm_tile_8x8_fused_asm<mm_tile_8x8_epi_relu_asm, true, false>;
+auto _mm_tile_8x8_asm_bias_gelu =
+    mm_tile_8x8_fused_asm<mm_tile_8x8_epi_gelu_asm, true, false>;
+auto _mm_tile_8x8_asm_bias_residual =
+    mm_tile_8x8_fused_asm<mm_tile_8x8_epi_asm, true, true>;
+auto _bias_pass = epilogue_pass<true, Activation::none, false>;
+auto _relu_pass = epilogue_pass<false, Activation::relu, false>;
+auto _gelu_pass = epilogue_pass<false, Activation::gelu, false>;
+auto _residual_pass = epilogue_pass<false, Activation::none, true>;
+auto _mm_ukr_8x8_asm = mm_ukr<8, 8, mm_ukr_8x8_asm>;
+auto _mm_ukr_12x8_asm = mm_ukr<12, 8, mm_ukr_12x8_asm>;
+auto _mm_ukr_8x12_asm = mm_ukr<8, 12, mm_ukr_8x12_asm>;
+auto _mm_ukr_16x4_asm = mm_ukr<16, 4, mm_ukr_16x4_asm>;
+auto _mm_ukr_4x16_asm = mm_ukr<4, 16, mm_ukr_4x16_asm>;
+auto _mm_jit_8x8 = mm_jit_8x8;
+auto _mm_small_16x16x16 = mm_small<16, 16, 16>;
+auto _mm_small_32x32x32 = mm_small<32, 32, 32>;
+auto _mm_small_48x48x48 = mm_small<48, 48, 48>;
+auto _mm_small_64x64x64 = mm_small<64, 64, 64>;
+auto _mm_small_20x36x18 = mm_small<20, 36, 18>;
+auto _mm_s8s32_tile_8x8 = mm_s8s32;
+auto _mm_s8_tile_8x8_requantize = mm_s8_requantize;
+auto _mm_tile_8x8_bf16 = mm_tile_half<Half::bf16>;
+auto _mm_tile_8x8_fp16 = mm_tile_half<Half::fp16>;
+auto _mm_panel_24_bf16 = mm_panel_half<Half::bf16>;
+auto _mm_panel_24_fp16 = mm_panel_half<Half::fp16>;
+auto _mm_baseline_f64 = mm_baseline<double>;
+auto _mm_tile_8x4_f64 = mm_tile_wide<double, 8, 4>;
+auto _mm_tile_4x8_f64 = mm_tile_wide<double, 4, 8>;
+auto _mm_baseline_c32 = mm_baseline<std::complex<float>>;
+auto _mm_tile_4x4_c32 = mm_tile_wide<std::complex<float>, 4, 4>;
+auto _mm_blocked_8x8 = mm_blocked<8, 8>;
+auto _mm_blocked_8x8_prepacked = mm_blocked_prepacked;
+auto _mm_tuned = mm_tuned;
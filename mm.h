@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+// c = alpha * op(a) * op(b) + beta * c
+// - all matrices are row major, lda/ldb/ldc are row strides in floats
+// - op(a) is m x k: a if !trans_a, else a is stored as k x m
+// - op(b) is k x n: b if !trans_b, else b is stored as n x k
+// - c is not read if beta == 0
+// - m == 1 or n == 1 with alpha == 1, beta == 0 and a contiguous vector run
+//   the matrix vector kernels, no packing
+void sgemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+           const float* a, int lda, const float* b, int ldb, float beta,
+           float* c, int ldc);
+
+// sgemm with the packing buffers in a caller provided workspace instead of
+// the thread local one
+// - workspace: sgemm_workspace_size() bytes, 64 byte aligned, or nullptr
+void sgemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+           const float* a, int lda, const float* b, int ldb, float beta,
+           float* c, int ldc, void* workspace);
+size_t sgemm_workspace_size();
+
+// op(b) packed once into the register tile layout, reusable by many a
+// - sgemm_pack_b: packs b, or returns the pack made before for the same b
+//   pointer, trans_b and shape; the pack is owned by the cache
+// - sgemm_unpack_b: drops every pack of b, or all packs if b is nullptr,
+//   must be called once b is modified or freed, handles of b are invalid
+// - sgemm_packed: sgemm with the packed op(b) of k x n, c is m x n
+struct sgemm_packed_b;
+const sgemm_packed_b* sgemm_pack_b(bool trans_b, int k, int n,
+                                   const float* b, int ldb);
+void sgemm_unpack_b(const float* b);
+void sgemm_packed(bool trans_a, int m, float alpha, const float* a, int lda,
+                  const sgemm_packed_b* b, float beta, float* c, int ldc);
+
+// c = a * b, dense row major, by the kernel variant fastest for the shape
+// - mm_autotune: times every kernel, tile size and packing variant on
+//   m x k and k x n data, saves the fastest to the tuning cache file,
+//   returns its name, prints all timings if verbose
+// - mm_tuned: runs the kernel tuned for the shape, the cache file is loaded
+//   at the first call, untuned shapes run the cache blocked kernel, no lock
+//   on the call path
+// - tuning cache file: env MM_TUNE_CACHE, default mm-tune.cache
+const char* mm_autotune(int m, int n, int k, bool verbose = false);
+void mm_tuned(const float* a, const float* b, float* c, int m, int n, int k);
+
+// batched c[i] = a[i] * b[i], dense row major, i = 0 ~ batch - 1
+// - a[i] = a + i * stride_a, likewise b[i] and c[i], strides in floats
+// - stride_a or stride_b 0: the operand is broadcast to the whole batch,
+//   a broadcast b is packed once for all matrices
+// - c matrices must not overlap
+void mm_batched(int batch, int m, int n, int k, const float* a, long stride_a,
+                const float* b, long stride_b, float* c, long stride_c);
+
+// one problem of a grouped gemm: c = a * b, dense row major, a is m x k,
+// b is k x n
+struct mm_problem {
+  int m, n, k;
+  const float* a;
+  const float* b;
+  float* c;
+};
+
+// persistent pinned worker threads, see multi-thread/thread-pool.h
+class ThreadPool;
+
+// c = a * b of every problem in one pass
+// - the c of all problems is split into blocks, one global list in problem
+//   order; threads take the next block from a shared counter, so the small
+//   problems do not leave threads idle behind the large ones
+// - pool: the caller's pool, all of its threads take blocks, no threads are
+//   created per call; nullptr runs inline
+void mm_grouped(int count, const mm_problem* problems,
+                ThreadPool* pool = nullptr);
@@ -1,38 +1,343 @@
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <thread>
 #include <vector>
 #include <unistd.h>
 
+#include "thread-pool.h"
+#include "work-stealing.h"
+
 using reorder_func = void(*)(const float*, const float*, float*, float*,
                              int, int, int);
 using mm_func = void(*)(const float*, const float*, float*, int, int, int);
+using parallel_mm_func = void(*)(ThreadPool&, const float*, const float*,
+                                 float*, float*, float*, int, int, int);
 extern reorder_func _reorder;
 extern mm_func _mm_tile_8x8;
+using rows_mm_func = void(*)(const float*, const float*, float*, int, int,
+                             int, int);
+using stream_mm_func = void(*)(const float*, const float*, float*, int, int,
+                               int, int, int, float*);
+extern parallel_mm_func _mm_tile_8x8_parallel;
+using plan_func = void(*)(int, int, int, int, int&, int&, int&);
+extern plan_func _mm_tile_8x8_parallel_plan;
+extern rows_mm_func _mm_tile_8x8_rows;
+extern stream_mm_func _mm_tile_8x8_stream;
+
+// packed a and b sizes of mm_tile_parallel, in floats
+long packed_a_size(int m, int k) {
+  return (m + 7L) / 8 * 8 * ((k + 3) / 4 * 4);
+}
+long packed_b_size(int k, int n) {
+  return (k + 3L) / 4 * 4 * ((n + 7) / 8 * 8);
+}
+
+// verify mm_tile_parallel against a plain loop
+// - shapes and thread counts are picked to cover every kind of plan: a
+//   column split (grid_n == threads), a row split (grid_n == 1), a 2d grid,
+//   k in one block and k split into blocks
+// - edges: m, n not whole tiles, k not a multiple of 4
+// - small integers keep every sum exact, whatever the k blocking
+int test_parallel() {
+  std::cout << "========== parallel ==========\n";
+  const struct {
+    int n_threads, m, n, k;
+  } shapes[] = {
+    {1,   64,   64,   64},
+    {4,   16, 1024,   64},
+    {4, 1024,   16,   64},
+    {4,  256,  256,   64},
+    {4,   64, 2048, 1024},
+    {4,  203,  150,   37},
+    {4,   13, 1001,  999},
+    {3,    5,    7,    3},
+  };
+  ThreadPool pool(4);
+  bool column = false, row = false, grid = false, k_whole = false,
+       k_split = false;
+  for (const auto [n_threads, m, n, k] : shapes) {
+    std::vector<float> a(static_cast<long>(m)*k), b(static_cast<long>(k)*n);
+    std::vector<float> a_tx(packed_a_size(m, k)), b_tx(packed_b_size(k, n));
+    std::vector<float> c(static_cast<long>(m)*n), t(c.size());
+    for (size_t i = 0; i < a.size(); ++i) a[i] = i % 7 - 3;
+    for (size_t i = 0; i < b.size(); ++i) b[i] = i % 5 - 2;
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+        float sum = 0;
+        for (int l = 0; l < k; ++l) sum += a[i*k + l] * b[l*n + j];
+        t[i*n + j] = sum;
+      }
+    }
+
+    int grid_m, grid_n, kc;
+    _mm_tile_8x8_parallel_plan(n_threads, m, n, k, grid_m, grid_n, kc);
+    std::cout << "threads=" << n_threads << ", " << m << 'x' << n << 'x' \
+              << k << ": grid=" << grid_m << 'x' << grid_n << ", kc=" \
+              << kc << '\n';
+    column |= n_threads > 1 && grid_n == n_threads;
+    row |= n_threads > 1 && grid_n == 1;
+    grid |= grid_m > 1 && grid_n > 1;
+    k_whole |= kc >= k;
+    k_split |= kc < k;
+
+    pool.set_threads(n_threads);
+    _mm_tile_8x8_parallel(pool, a.data(), b.data(), a_tx.data(),
+                          b_tx.data(), c.data(), m, n, k);
+    for (long i = 0; i < static_cast<long>(m)*n; ++i) {
+      if (c[i] != t[i]) {
+        std::cerr << "FAILED! [" << i << "]: expect " << t[i] << ", get " \
+                  << c[i] << '\n';
+        return 1;
+      }
+    }
+  }
+  if (!(column && row && grid && k_whole && k_split)) {
+    std::cerr << "FAILED! shapes do not cover every kind of plan\n";
+    return 1;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
+
+// one large matrix multiplied by 1 ~ max_threads threads
+// - one pool of max_threads, each count runs on its first threads
+// - report time, gflops and scaling efficiency against 1 thread
+// - results must be identical to 1 thread
+int bench_single(int max_threads, int m, int n, int k) {
+  std::cout << "m=" << m << ", n=" << n << ", k=" << k << '\n';
+
+  float *a = new float[static_cast<long>(m)*k];
+  float *b = new float[static_cast<long>(k)*n];
+  float *c = new float[static_cast<long>(m)*n];
+  float *t = new float[static_cast<long>(m)*n];
+  float *a_tx = new float[packed_a_size(m, k)];
+  float *b_tx = new float[packed_b_size(k, n)];
+  for (long i = 0; i < static_cast<long>(m)*k; ++i) a[i] = i % 17 - 8;
+  for (long i = 0; i < static_cast<long>(k)*n; ++i) b[i] = i % 13 - 6;
 
+  // 1, 2, 4, ..., max_threads
+  std::vector<int> thread_counts;
+  for (int i = 1; i < max_threads; i *= 2) thread_counts.push_back(i);
+  thread_counts.push_back(max_threads);
+
+  ThreadPool pool(max_threads);
+  double time_1 = 0;
+  for (const int n_threads : thread_counts) {
+    pool.set_threads(n_threads);
+    constexpr int loops = 5;
+    // warmup
+    _mm_tile_8x8_parallel(pool, a, b, a_tx, b_tx, c, m, n, k);
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < loops; ++i) {
+      _mm_tile_8x8_parallel(pool, a, b, a_tx, b_tx, c, m, n, k);
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double time = std::chrono::duration<double>(end - start).count()
+                      / loops;
+    if (n_threads == 1) {
+      time_1 = time;
+      std::memcpy(t, c, sizeof(float) * m * n);
+    } else if (std::memcmp(t, c, sizeof(float) * m * n)) {
+      std::cerr << "FAILED! threads=" << n_threads << " result mismatch\n";
+      return 1;
+    }
+    const double gflops = 2.0 * m * n * k / time / 1e9;
+    std::cout << "threads=" << n_threads << ", time=" << time * 1e3 \
+              << " ms, gflops=" << gflops << ", efficiency=" \
+              << time_1 / (time * n_threads) * 100 << "%\n";
+  }
+
+  delete[] a;
+  delete[] b;
+  delete[] c;
+  delete[] t;
+  delete[] a_tx;
+  delete[] b_tx;
+  return 0;
+}
+
+// batch of matrices with random shapes, multiplied by 1 ~ max_threads threads
+// - one pool of max_threads, each count runs on its first threads
+// - static: the batch is split evenly by count, one mini batch per thread
+// - stealing: reorder one task per matrix, multiply one task per matrix
+//   split into rows of tiles on demand, both by the work stealing scheduler
+// - report time of both and scaling efficiency of stealing against 1 thread
+int bench_mixed(int max_threads, int batch) {
+  struct Gemm {
+    int m, n, k;
+    std::vector<float> a, b, c, a_tx, b_tx;
+  };
+  // m: 8 ~ 2048, n: 8 ~ 512, k: 4 ~ 512, skewed to small sizes
+  std::vector<Gemm> gemms(batch);
+  unsigned seed = 2024;
+  auto rand = [&seed](int lo, int hi, int align) {
+    seed = seed * 1103515245 + 12345;
+    const double r = (seed >> 8) / static_cast<double>(1 << 24);
+    return (lo + static_cast<int>((hi - lo) * r * r)) / align * align + align;
+  };
+  long flops = 0;
+  for (auto& g : gemms) {
+    g.m = rand(0, 2048, 8);
+    g.n = rand(0, 512, 8);
+    g.k = rand(0, 512, 4);
+    g.a.resize(g.m * g.k);
+    g.b.resize(g.k * g.n);
+    g.c.resize(g.m * g.n);
+    g.a_tx.resize(g.m * g.k);
+    g.b_tx.resize(g.k * g.n);
+    for (int i = 0; i < g.m * g.k; ++i) g.a[i] = i % 17 - 8;
+    for (int i = 0; i < g.k * g.n; ++i) g.b[i] = i % 13 - 6;
+    flops += 2L * g.m * g.n * g.k;
+  }
+  std::cout << "batch=" << batch << ", gflop=" << flops / 1e9 << '\n';
+
+  auto reorder = [&gemms](int i) {
+    auto& g = gemms[i];
+    _reorder(g.a.data(), g.b.data(), g.a_tx.data(), g.b_tx.data(),
+             g.m, g.n, g.k);
+  };
+  auto multiply = [&gemms](int i, int begin, int end) {
+    auto& g = gemms[i];
+    _mm_tile_8x8_rows(g.a_tx.data(), g.b_tx.data(), g.c.data(), g.n, g.k,
+                      begin * 8, end * 8);
+  };
+
+  std::vector<int> one(batch, 1), m_tiles(batch);
+  for (int i = 0; i < batch; ++i) m_tiles[i] = gemms[i].m / 8;
+
+  // 1, 2, 4, ..., max_threads
+  std::vector<int> thread_counts;
+  for (int i = 1; i < max_threads; i *= 2) thread_counts.push_back(i);
+  thread_counts.push_back(max_threads);
+
+  ThreadPool pool(max_threads);
+  std::vector<std::vector<float>> expect;
+  double time_1 = 0;
+  for (const int n_threads : thread_counts) {
+    pool.set_threads(n_threads);
+    // one deque per thread of this count
+    WorkStealing sched(pool);
+    using clock = std::chrono::high_resolution_clock;
+    constexpr int loops = 3;
+
+    // static split by count
+    auto start = clock::now();
+    for (int l = 0; l < loops; ++l) {
+      pool.run([&](int idx) {
+        int si, ei;
+        split(batch, n_threads, idx, si, ei);
+        for (int i = si; i < ei; ++i) {
+          reorder(i);
+          multiply(i, 0, m_tiles[i]);
+        }
+      });
+    }
+    const double time_static =
+        std::chrono::duration<double>(clock::now() - start).count() / loops;
+    if (expect.empty()) {
+      for (const auto& g : gemms) expect.push_back(g.c);
+    }
+
+    // work stealing
+    for (auto& g : gemms) std::fill(g.c.begin(), g.c.end(), 0.f);
+    sched.reset_stats();
+    start = clock::now();
+    for (int l = 0; l < loops; ++l) {
+      sched.run(one, [&](int i, int, int) { reorder(i); });
+      sched.run(m_tiles, multiply);
+    }
+    const double time_steal =
+        std::chrono::duration<double>(clock::now() - start).count() / loops;
+    for (int i = 0; i < batch; ++i) {
+      if (gemms[i].c != expect[i]) {
+        std::cerr << "FAILED! threads=" << n_threads << " matrix " << i \
+                  << " result mismatch\n";
+        return 1;
+      }
+    }
+
+    if (n_threads == 1) time_1 = time_steal;
+    const auto stats = sched.stats();
+    std::cout << "threads=" << n_threads \
+              << ", static=" << time_static * 1e3 << " ms" \
+              << ", stealing=" << time_steal * 1e3 << " ms" \
+              << ", gflops=" << flops / time_steal / 1e9 \
+              << ", efficiency=" << time_1 / (time_steal * n_threads) * 100 \
+              << "%, steals=" << stats.steals / loops \
+              << ", splits=" << stats.splits / loops << '\n';
+  }
+  return 0;
+}
+
+// - no args: batch benchmark, MM_NUM_THREADS threads, runs forever
+// - stream: batch benchmark, each matrix reordered into a per thread pack
+//   buffer right before it is multiplied, runs forever
+// - test: verify the parallel driver
+// - single [m n k]: one large matrix, 1 ~ MM_NUM_THREADS threads (default
+//   all cpus), matrix shape defaults to 4096^3
+// - mixed [batch]: batch of random shapes, 1 ~ MM_NUM_THREADS threads
+//   (default all cpus), batch size defaults to 256
 int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "test") {
+    return test_parallel();
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "mixed") {
+    const char* threads = std::getenv("MM_NUM_THREADS");
+    const int max_threads = threads ? std::atoi(threads)
+                                    : std::thread::hardware_concurrency();
+    const int batch = argc == 3 ? std::atoi(argv[2]) : 256;
+    if (max_threads <= 0 || batch <= 0) {
+      std::cerr << "invalid thread count or batch size\n";
+      return 1;
+    }
+    return bench_mixed(max_threads, batch);
+  }
+
+  if (argc > 1 && std::string(argv[1]) == "single") {
+    const char* threads = std::getenv("MM_NUM_THREADS");
+    const int max_threads = threads ? std::atoi(threads)
+                                    : std::thread::hardware_concurrency();
+    int m = 4096, n = 4096, k = 4096;
+    if (argc == 5) {
+      m = std::atoi(argv[2]);
+      n = std::atoi(argv[3]);
+      k = std::atoi(argv[4]);
+    }
+    if (max_threads <= 0 || m <= 0 || n <= 0 || k <= 0) {
+      std::cerr << "invalid thread count or size\n";
+      return 1;
+    }
+    return bench_single(max_threads, m, n, k);
+  }
+
   constexpr int batch = 2048;
   constexpr int m = 512, n = 256, k = 128;
+  // pack buffer per thread in stream mode: 384K, fits 1M L2
+  constexpr int pack_size = m*k + k*n;
+  const bool stream = argc > 1 && std::string(argv[1]) == "stream";
 
   const int n_threads = []() {
     const char* threads = std::getenv("MM_NUM_THREADS");
     if (!threads) return 1;
     return std::atoi(threads);
   }();
-  if (n_threads == 0) {
+  if (n_threads <= 0) {
     std::cerr << "invalid thread count\n";
     return 1;
-  } else if (batch % n_threads != 0) {
-    std::cerr << "thread count must divide batch size " << batch << " \n";
-    return 1;
   }
-  const int mini_batch = batch / n_threads;
 
   // initialize data
   float *a = new float[batch*m*k];
   float *b = new float[batch*k*n];
   float *c = new float[batch*m*n]{};
-  float *a_tx = new float[batch*m*k]{};
-  float *b_tx = new float[batch*k*n]{};
+  // full size packed a and b in two phase mode, one pack per thread in
+  // stream mode
+  float *a_tx = stream ? nullptr : new float[batch*m*k]{};
+  float *b_tx = stream ? nullptr : new float[batch*k*n]{};
+  float *pack = stream ? new float[n_threads*pack_size]{} : nullptr;
 
   auto init_data = [](float* data, int size) {
     for (int i = 0; i < size; ++i) {
@@ -43,49 +348,59 @@ int main(int argc, char* argv[]) {
   init_data(b, batch*k*n);
 
   // define reorder and multiplier functor
-  auto reorder = [a, b, a_tx, b_tx, mini_batch](int idx) {
-    const int si = idx * mini_batch;
-    const int ei = si + mini_batch;
+  // - thread idx works on mini batch [si, ei)
+  auto reorder = [a, b, a_tx, b_tx, n_threads](int idx) {
+    int si, ei;
+    split(batch, n_threads, idx, si, ei);
     for (long i = si; i < ei; ++i) {
       _reorder(a + i*m*k, b + i*k*n, a_tx + i*m*k, b_tx + i*k*n, m, n, k);
     }
   };
-  auto multiplier = [a_tx, b_tx, c, mini_batch](int idx) {
-    const int si = idx * mini_batch;
-    const int ei = si + mini_batch;
+  auto multiplier = [a_tx, b_tx, c, n_threads](int idx) {
+    int si, ei;
+    split(batch, n_threads, idx, si, ei);
     for (long i = si; i < ei; ++i) {
       _mm_tile_8x8(a_tx + i*m*k, b_tx + i*k*n, c + i*m*n, m, n, k);
     }
   };
+  auto streamer = [a, b, c, pack, n_threads](int idx) {
+    int si, ei;
+    split(batch, n_threads, idx, si, ei);
+    _mm_tile_8x8_stream(a, b, c, m, n, k, si, ei, pack + idx*pack_size);
+  };
 
   // run the benchmark
-  std::vector<std::thread> worker(n_threads);
+  // - workers are created once, pinned and reused by every phase
+  ThreadPool pool(n_threads);
+  const std::function<void(int)> reorder_task = reorder;
+  const std::function<void(int)> multiplier_task = multiplier;
+  const std::function<void(int)> stream_task = streamer;
   while (true) {
+    pool.reset_stats();
     const auto start = std::chrono::high_resolution_clock::now();
 
     const int bench_loops = n_threads;
     for (int i = 0; i < bench_loops; ++i) {
-      // - do reorder with n_threads in parallel
-      for (int i = 0; i < n_threads; ++i) {
-        worker[i] = std::thread(reorder, i);
-      }
-      for (int i = 0; i < n_threads; ++i) {
-        worker[i].join();
+      if (stream) {
+        // - do reorder and multiplication in one phase
+        pool.run(stream_task);
+        continue;
       }
+      // - do reorder with n_threads in parallel
+      pool.run(reorder_task);
       // - do matrix multiplication with n_threads in parallel
-      for (int i = 0; i < n_threads; ++i) {
-        worker[i] = std::thread(multiplier, i);
-      }
-      for (int i = 0; i < n_threads; ++i) {
-        worker[i].join();
-      }
+      pool.run(multiplier_task);
     }
 
     const auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> duration = end - start;
     const long ops = static_cast<long>(n_threads * batch / duration.count());
+    // average time per phase spent waking workers and in the final barrier
+    const auto stats = pool.stats();
     std::cout << "pid=" << getpid() << ", threads=" << n_threads \
-              << ", ops=" << ops << '\n';
+              << ", ops=" << ops \
+              << ", dispatch=" << stats.dispatch_us / stats.runs << "us" \
+              << ", barrier=" << stats.barrier_us / stats.runs << "us\n";
 #if 0
     std::cerr << "c[0]    = " << c[0] << '\n';
     std::cerr << "c[9973] = " << c[9973] << '\n';
@@ -98,5 +413,6 @@ int main(int argc, char* argv[]) {
   delete[] c;
   delete[] a_tx;
   delete[] b_tx;
+  delete[] pack;
   return 0;
 }
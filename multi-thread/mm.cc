@@ -1,18 +1,28 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <arm_neon.h>
 
+#include "thread-pool.h"
+
 // calculate c by tile
 // - visit a by row panels, b by column panels
 // - a, b must be pre-reordered
 // - reduce memory accesses and total instructions
 // - clang16 vectorizes the code quite good: https://godbolt.org/z/MWvefG6ds
+// - only c tiles in rows [mm_begin, mm_end) and cols [nn_begin, nn_end) are
+//   calculated, all bounds are multiples of the tile size
+// - only [kk_begin, kk_end) of k is summed, multiples of 4, the sum is added
+//   to c unless kk_begin is 0
+// - k: of the packed a and b, a multiple of 4; tiles past row m or column n
+//   of c are stored in part
 template <int tile_height = 8, int tile_width = 8>
-static void mm_tile(const float* __restrict a_tx, const float* __restrict b_tx,
-                    float* __restrict c, int m, int n, int k) {
-  // XXX: ignore edge case for now
+static void mm_tile_block(const float* __restrict a_tx,
+                          const float* __restrict b_tx,
+                          float* __restrict c, int m, int n, int k,
+                          int mm_begin, int mm_end, int nn_begin, int nn_end,
+                          int kk_begin, int kk_end) {
   static_assert(tile_height % 4 == 0 && tile_width % 4 == 0);
-  if (m % tile_height || n % tile_width || k % 4) std::abort();
 
   // a: tile_height * 4; b: 4 * tile_width; c: tile_height * tile_width
   float32x4_t tile_a[tile_height];
@@ -24,9 +34,9 @@ static void mm_tile(const float* __restrict a_tx, const float* __restrict b_tx,
   static_assert(total_size <= 32 * 16);
 
   // nn: start column of matrix c's tile under calculation
-  for (int nn = 0; nn < n; nn += tile_width) {
+  for (int nn = nn_begin; nn < nn_end; nn += tile_width) {
     // mm: start row of matrix c's tile under calculation
-    for (int mm = 0; mm < m; mm += tile_height) {
+    for (int mm = mm_begin; mm < mm_end; mm += tile_height) {
       // calculate c tile starts from [mm, nn]
       //
       // panel a:              panel b:                tile c:
@@ -43,14 +53,23 @@ static void mm_tile(const float* __restrict a_tx, const float* __restrict b_tx,
       // v     |         |                           v     |             |
       // ......+---------+                           ......+-------------+
       //       |<-- k -->|                                 |<---- n ---->|
-      const float* a_ptr = a_tx + mm * k;
-      const float* b_ptr = b_tx + nn * k;
+      const float* a_ptr = a_tx + mm * k + kk_begin * tile_height;
+      const float* b_ptr = b_tx + nn * k + kk_begin * tile_width;
       float *c_ptr = c + mm * n + nn;
+      const int rows = std::min(tile_height, m - mm);
+      const int cols = std::min(tile_width, n - nn);
 
-      // calculate tile c
-      std::memset(tile_c, 0, sizeof(tile_c));
+      // calculate tile c, on top of the k blocks before
+      if (kk_begin == 0 || rows < tile_height || cols < tile_width) {
+        std::memset(tile_c, 0, sizeof(tile_c));
+      }
+      if (kk_begin > 0) {
+        for (int h = 0; h < rows; ++h) {
+          std::memcpy(tile_c[h], c_ptr + h * n, cols * sizeof(float));
+        }
+      }
       // kk: iterate panel_a by 4 cols and panel_b by 4 rows (one vector)
-      for (int kk = 0; kk < k; kk += 4) {
+      for (int kk = kk_begin; kk < kk_end; kk += 4) {
         // load tile a: rows = tile_height, cols = 4
         std::memcpy(tile_a, a_ptr, sizeof(tile_a));
         a_ptr += sizeof(tile_a) / 4/*sizeof(float)*/;
@@ -72,39 +91,205 @@ static void mm_tile(const float* __restrict a_tx, const float* __restrict b_tx,
       }
 
       // store to c tile
-      for (int h = 0; h < tile_height; ++h) {
-        std::memcpy(c_ptr + h * n, tile_c[h], tile_width * sizeof(float));
+      if (rows == tile_height && cols == tile_width) {
+        for (int h = 0; h < tile_height; ++h) {
+          std::memcpy(c_ptr + h * n, tile_c[h], tile_width * sizeof(float));
+        }
+      } else {
+        for (int h = 0; h < rows; ++h) {
+          std::memcpy(c_ptr + h * n, tile_c[h], cols * sizeof(float));
+        }
       }
     }
   }
 }
 
 template <int tile_height = 8, int tile_width = 8>
-void reorder(const float* __restrict a, const float* __restrict b,
-             float* __restrict a_tx, float* __restrict b_tx,
-             int m, int n, int k) {
-  // transpose each row panel of a for sequential memory access
-  float* a_tx_ptr = a_tx;
-  for (int mm = 0; mm < m; mm += tile_height) {
+static void mm_tile(const float* __restrict a_tx, const float* __restrict b_tx,
+                    float* __restrict c, int m, int n, int k) {
+  // XXX: ignore edge case for now
+  if (m % tile_height || n % tile_width || k % 4) std::abort();
+  mm_tile_block<tile_height, tile_width>(a_tx, b_tx, c, m, n, k, 0, m, 0, n,
+                                         0, k);
+}
+
+// rows [mm_begin, mm_end) of c, unit of work of the work stealing scheduler
+// - whole tiles, like mm_tile
+template <int tile_height = 8, int tile_width = 8>
+static void mm_tile_rows(const float* __restrict a_tx,
+                         const float* __restrict b_tx,
+                         float* __restrict c, int n, int k,
+                         int mm_begin, int mm_end) {
+  mm_tile_block<tile_height, tile_width>(a_tx, b_tx, c, mm_end, n, k,
+                                         mm_begin, mm_end, 0, n, 0, k);
+}
+
+// transpose row panels [mm_begin, mm_end) of a for sequential memory access
+// - rows past m and k past a multiple of 4 are padded with zeros
+template <int tile_height = 8>
+static void reorder_a(const float* __restrict a, float* __restrict a_tx,
+                      int m, int k, int mm_begin, int mm_end) {
+  const int k_pad = (k + 3) / 4 * 4;
+  float* a_tx_ptr = a_tx + mm_begin * k_pad;
+  for (int mm = mm_begin; mm < mm_end; mm += tile_height) {
     const float* a_ptr = a + mm * k;
-    for (int col = 0; col < k; col += 4) {
+    for (int col = 0; col < k_pad; col += 4) {
       for (int row = 0; row < tile_height; ++row) {
-        std::memcpy(a_tx_ptr, a_ptr + row * k + col, 4 * sizeof(float));
+        if (mm + row < m && col + 4 <= k) {
+          std::memcpy(a_tx_ptr, a_ptr + row * k + col, 4 * sizeof(float));
+        } else {
+          for (int i = 0; i < 4; ++i) {
+            a_tx_ptr[i] =
+                mm + row < m && col + i < k ? a_ptr[row * k + col + i] : 0.f;
+          }
+        }
         a_tx_ptr += 4;
       }
     }
   }
+}
 
-  // transpose each column panel of b for sequential memory access
-  float* b_tx_ptr = b_tx;
-  for (int nn = 0; nn < n; nn += tile_width) {
+// transpose column panels [nn_begin, nn_end) of b for sequential memory access
+// - columns past n and k past a multiple of 4 are padded with zeros
+template <int tile_width = 8>
+static void reorder_b(const float* __restrict b, float* __restrict b_tx,
+                      int n, int k, int nn_begin, int nn_end) {
+  const int k_pad = (k + 3) / 4 * 4;
+  float* b_tx_ptr = b_tx + nn_begin * k_pad;
+  for (int nn = nn_begin; nn < nn_end; nn += tile_width) {
     const float* b_ptr = b + nn;
-    for (int row = 0; row < k; ++row) {
-      std::memcpy(b_tx_ptr, b_ptr + row * n, tile_width * sizeof(float));
+    const int cols = std::min(tile_width, n - nn);
+    for (int row = 0; row < k_pad; ++row) {
+      if (row < k && cols == tile_width) {
+        std::memcpy(b_tx_ptr, b_ptr + row * n, tile_width * sizeof(float));
+      } else {
+        for (int w = 0; w < tile_width; ++w) {
+          b_tx_ptr[w] = row < k && w < cols ? b_ptr[row * n + w] : 0.f;
+        }
+      }
       b_tx_ptr += tile_width;
     }
   }
 }
 
+template <int tile_height = 8, int tile_width = 8>
+void reorder(const float* __restrict a, const float* __restrict b,
+             float* __restrict a_tx, float* __restrict b_tx,
+             int m, int n, int k) {
+  reorder_a<tile_height>(a, a_tx, m, k, 0, m);
+  reorder_b<tile_width>(b, b_tx, n, k, 0, n);
+}
+
+// multiply matrices [begin, end) of a batch, each packed right before it
+// is multiplied
+// - one pack buffer reused by every matrix, so packed data is consumed
+//   while still in L2 instead of round tripping through dram
+// - packing ahead would only put more traffic between the pack and its use
+//   on the same thread, nothing overlaps
+// - pack: m * k + k * n floats, 384K at the benchmark shape, fits 1M L2
+template <int tile_height = 8, int tile_width = 8>
+static void mm_tile_stream(const float* __restrict a,
+                           const float* __restrict b,
+                           float* __restrict c, int m, int n, int k,
+                           int begin, int end, float* __restrict pack) {
+  const long a_size = static_cast<long>(m) * k;
+  const long b_size = static_cast<long>(k) * n;
+  const long c_size = static_cast<long>(m) * n;
+  float* a_tx = pack;
+  float* b_tx = pack + a_size;
+  for (long i = begin; i < end; ++i) {
+    reorder<tile_height, tile_width>(a + i * a_size, b + i * b_size,
+                                     a_tx, b_tx, m, n, k);
+    mm_tile<tile_height, tile_width>(a_tx, b_tx, c + i * c_size, m, n, k);
+  }
+}
+
+// grid of c blocks and k block size of mm_tile_parallel
+// - kc: the largest multiple of 4 that keeps the kc * (n / grid_n) block of
+//   b of a thread in l2_budget, while the 8 rows of a against it stay in L1
+// - grid_m * grid_n == n_threads, g == n_threads included, the one with the
+//   least memory traffic per thread: a and b blocks are read once each, c
+//   is read and written once per k block
+template <int tile_height = 8, int tile_width = 8>
+static void mm_tile_parallel_plan(int n_threads, int m, int n, int k,
+                                  int& grid_m, int& grid_n, int& kc) {
+  // half of 1M L2 (neoverse n1/n2), leave room for a and c
+  constexpr long l2_budget = 512 * 1024;
+
+  const int m_tiles = (m + tile_height - 1) / tile_height;
+  const int n_tiles = (n + tile_width - 1) / tile_width;
+  const long k4 = (k + 3) / 4 * 4;
+  double best = 1e300;
+  for (int g = 1; g <= n_threads; ++g) {
+    if (n_threads % g) continue;
+    const long mb = (m_tiles + n_threads / g - 1) / (n_threads / g) *
+                    static_cast<long>(tile_height);
+    const long nb = (n_tiles + g - 1) / g * static_cast<long>(tile_width);
+    const long kb = std::min(k4, std::max(4L, l2_budget / (nb * 4) / 4 * 4));
+    const long k_blocks = (k4 + kb - 1) / kb;
+    const double traffic = static_cast<double>(mb) * k4 + nb * k4 +
+                           2.0 * mb * nb * k_blocks;
+    if (traffic < best) {
+      best = traffic;
+      grid_n = g;
+      grid_m = n_threads / g;
+      kc = kb;
+    }
+  }
+}
+
+// one large matrix multiplication on all threads of the pool, any shape
+// - a_tx, b_tx: a and b packed to whole tiles and k to a multiple of 4,
+//   round_up(m, tile_height) * round_up(k, 4) and
+//   round_up(k, 4) * round_up(n, tile_width) floats
+// - reorder: row panels of a and column panels of b are split evenly
+// - multiply: c tiles are split into a grid_m * grid_n grid of blocks, one
+//   block per thread, k is split into blocks of kc
+// - per k block, each row panel of a thread's block of a (8 * kc, in L1) is
+//   multiplied by its kc * (n / grid_n) block of b (in L2), see
+//   mm_tile_parallel_plan
+template <int tile_height = 8, int tile_width = 8>
+static void mm_tile_parallel(ThreadPool& pool,
+                             const float* __restrict a,
+                             const float* __restrict b,
+                             float* __restrict a_tx, float* __restrict b_tx,
+                             float* __restrict c, int m, int n, int k) {
+  const int n_threads = pool.size();
+  const int m_tiles = (m + tile_height - 1) / tile_height;
+  const int n_tiles = (n + tile_width - 1) / tile_width;
+  const int k_pad = (k + 3) / 4 * 4;
+  int grid_m, grid_n, kc;
+  mm_tile_parallel_plan<tile_height, tile_width>(n_threads, m, n, k,
+                                                 grid_m, grid_n, kc);
+
+  pool.run([=](int idx) {
+    int begin, end;
+    split(m_tiles, n_threads, idx, begin, end);
+    reorder_a<tile_height>(a, a_tx, m, k, begin * tile_height,
+                           end * tile_height);
+    split(n_tiles, n_threads, idx, begin, end);
+    reorder_b<tile_width>(b, b_tx, n, k, begin * tile_width, end * tile_width);
+  });
+
+  pool.run([=](int idx) {
+    int mm_begin, mm_end, nn_begin, nn_end;
+    split(m_tiles, grid_m, idx / grid_n, mm_begin, mm_end);
+    split(n_tiles, grid_n, idx % grid_n, nn_begin, nn_end);
+    for (int kk = 0; kk < k_pad; kk += kc) {
+      const int kk_end = std::min(k_pad, kk + kc);
+      for (int mm = mm_begin; mm < mm_end; ++mm) {
+        mm_tile_block<tile_height, tile_width>(
+            a_tx, b_tx, c, m, n, k_pad, mm * tile_height,
+            (mm + 1) * tile_height, nn_begin * tile_width,
+            nn_end * tile_width, kk, kk_end);
+      }
+    }
+  });
+}
+
 auto _mm_tile_8x8= mm_tile<8, 8>;
 auto _reorder = reorder<8, 8>;
+auto _mm_tile_8x8_parallel = mm_tile_parallel<8, 8>;
+auto _mm_tile_8x8_parallel_plan = mm_tile_parallel_plan<8, 8>;
+auto _mm_tile_8x8_rows = mm_tile_rows<8, 8>;
+auto _mm_tile_8x8_stream = mm_tile_stream<8, 8>;
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// [begin, end) of part idx when splitting total units into parts evenly
+inline void split(int total, int parts, int idx, int& begin, int& end) {
+  begin = static_cast<long>(total) * idx / parts;
+  end = static_cast<long>(total) * (idx + 1) / parts;
+}
+
+// persistent worker threads, pinned to cpus, alive for the pool lifetime
+// - run(func) calls func(0) ~ func(n_threads-1) in parallel and returns when
+//   all are done, the calling thread runs func(0)
+// - dispatch: workers spin on a generation counter, bumped once per run
+// - barrier: each worker decrements a pending counter, caller spins on it
+// - no locks and no syscalls on the dispatch path
+// - set_threads(n) runs on the first n threads only, the others still take
+//   part in the barrier, so one pool serves every thread count on the same
+//   cpus
+class ThreadPool {
+ public:
+  // accumulated timing of all runs
+  // - dispatch: from run() start until the last worker wakes up
+  // - barrier: from the last func() done until run() returns
+  struct Stats {
+    long runs;
+    double dispatch_us;
+    double barrier_us;
+  };
+
+  explicit ThreadPool(int n_threads) : n_threads_(n_threads),
+                                       capacity_(n_threads),
+                                       slots_(n_threads) {
+    // pin to cpus allowed at startup, round robin if threads > cpus
+    // - the caller runs func(0) on cpus[0], its mask is restored at exit
+    const std::vector<int>& cpus = startup_cpus();
+    caller_ = pthread_self();
+    caller_pinned_ = !cpus.empty() &&
+        pthread_getaffinity_np(caller_, sizeof(caller_mask_),
+                               &caller_mask_) == 0;
+    if (caller_pinned_) pin(caller_, cpus[0]);
+
+    for (int i = 1; i < capacity_; ++i) {
+      workers_.emplace_back([this, i] { worker_loop(i); });
+      if (!cpus.empty()) {
+        pin(workers_.back().native_handle(), cpus[i % cpus.size()]);
+      }
+    }
+  }
+
+  ~ThreadPool() {
+    stop_.store(true, std::memory_order_relaxed);
+    generation_.fetch_add(1, std::memory_order_release);
+    for (auto& worker : workers_) worker.join();
+    if (caller_pinned_) {
+      pthread_setaffinity_np(caller_, sizeof(caller_mask_), &caller_mask_);
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // threads of the following runs, 1 ~ capacity()
+  int size() const { return n_threads_; }
+  int capacity() const { return capacity_; }
+  void set_threads(int n_threads) {
+    n_threads_ = std::min(std::max(n_threads, 1), capacity_);
+  }
+
+  void run(const std::function<void(int)>& func) {
+    func_ = &func;
+    pending_.store(capacity_ - 1, std::memory_order_relaxed);
+    const std::int64_t start = now_ns();
+    generation_.fetch_add(1, std::memory_order_release);
+
+    func(0);
+    slots_[0].wake = start;
+    slots_[0].done = now_ns();
+
+    for (int spins = 0; pending_.load(std::memory_order_acquire); ++spins) {
+      pause(spins);
+    }
+    const std::int64_t end = now_ns();
+
+    std::int64_t last_wake = start, last_done = start;
+    for (int i = 0; i < n_threads_; ++i) {
+      last_wake = std::max(last_wake, slots_[i].wake);
+      last_done = std::max(last_done, slots_[i].done);
+    }
+    ++stats_.runs;
+    stats_.dispatch_us += (last_wake - start) / 1e3;
+    stats_.barrier_us += (end - last_done) / 1e3;
+  }
+
+  Stats stats() const { return stats_; }
+  void reset_stats() { stats_ = {}; }
+
+ private:
+  // written by one worker, read by the caller after the barrier
+  struct alignas(64) Slot {
+    std::int64_t wake;
+    std::int64_t done;
+  };
+
+  void worker_loop(int idx) {
+    unsigned seen = 0;
+    while (true) {
+      unsigned gen;
+      for (int spins = 0;
+           (gen = generation_.load(std::memory_order_acquire)) == seen;
+           ++spins) {
+        pause(spins);
+      }
+      seen = gen;
+      if (stop_.load(std::memory_order_relaxed)) return;
+
+      // n_threads_ only changes between runs, after the barrier
+      if (idx < n_threads_) {
+        slots_[idx].wake = now_ns();
+        (*func_)(idx);
+        slots_[idx].done = now_ns();
+      }
+      pending_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  // busy wait, give up the cpu if waiting too long (e.g. oversubscribed)
+  static void pause(int spins) {
+    if (spins < 4096) {
+#if defined(__aarch64__)
+      asm volatile("yield" ::: "memory");
+#endif
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  // cpus the process may run on, taken once before any pool pins its caller,
+  // so later pools see all of them too
+  static const std::vector<int>& startup_cpus() {
+    static const std::vector<int> cpus = [] {
+      std::vector<int> cpus;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+          if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+      }
+      return cpus;
+    }();
+    return cpus;
+  }
+
+  static void pin(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+  }
+
+  static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  int n_threads_;
+  const int capacity_;
+  std::vector<std::thread> workers_;
+  std::vector<Slot> slots_;
+  const std::function<void(int)>* func_{};
+  pthread_t caller_;
+  cpu_set_t caller_mask_;
+  bool caller_pinned_ = false;
+  Stats stats_{};
+
+  alignas(64) std::atomic<unsigned> generation_{0};
+  alignas(64) std::atomic<int> pending_{0};
+  std::atomic<bool> stop_{false};
+};
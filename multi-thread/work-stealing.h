@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "thread-pool.h"
+
+// work stealing scheduler on top of ThreadPool
+// - a problem is a range of units, e.g. one gemm and its rows of c tiles
+// - a task is a sub range [begin, end) of one problem
+// - each worker owns a deque, pops tasks from the back, thieves steal from
+//   the front where the larger, older tasks are
+// - a popped task is split in half while some worker is out of work, one
+//   half goes back to the deque for thieves, down to grain units
+class WorkStealing {
+ public:
+  struct Task {
+    int id;
+    int begin;
+    int end;
+  };
+
+  struct Stats {
+    long steals;
+    long splits;
+  };
+
+  explicit WorkStealing(ThreadPool& pool)
+      : pool_(pool), queues_(pool.size()) {}
+
+  // call func(id, begin, end) until all units of all problems are done
+  // - units[id]: number of units of problem id
+  // - problems are dealt to the workers round robin
+  void run(const std::vector<int>& units,
+           const std::function<void(int, int, int)>& func, int grain = 1) {
+    long total = 0;
+    for (int id = 0; id < static_cast<int>(units.size()); ++id) {
+      if (units[id] <= 0) continue;
+      queues_[id % queues_.size()].tasks.push_back({id, 0, units[id]});
+      total += units[id];
+    }
+    remaining_.store(total, std::memory_order_relaxed);
+    hungry_.store(0, std::memory_order_relaxed);
+
+    pool_.run([&](int idx) { worker_loop(idx, func, grain); });
+  }
+
+  Stats stats() const {
+    return {steals_.load(std::memory_order_relaxed),
+            splits_.load(std::memory_order_relaxed)};
+  }
+  void reset_stats() {
+    steals_.store(0, std::memory_order_relaxed);
+    splits_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  struct alignas(64) Queue {
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    std::deque<Task> tasks;
+
+    void acquire() {
+      while (lock.test_and_set(std::memory_order_acquire)) {}
+    }
+    void release() { lock.clear(std::memory_order_release); }
+
+    bool pop_back(Task& task) {
+      acquire();
+      const bool ok = !tasks.empty();
+      if (ok) {
+        task = tasks.back();
+        tasks.pop_back();
+      }
+      release();
+      return ok;
+    }
+    bool pop_front(Task& task) {
+      acquire();
+      const bool ok = !tasks.empty();
+      if (ok) {
+        task = tasks.front();
+        tasks.pop_front();
+      }
+      release();
+      return ok;
+    }
+    void push_back(const Task& task) {
+      acquire();
+      tasks.push_back(task);
+      release();
+    }
+  };
+
+  bool steal(int idx, Task& task) {
+    const int n = queues_.size();
+    for (int i = 1; i < n; ++i) {
+      if (queues_[(idx + i) % n].pop_front(task)) {
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void worker_loop(int idx, const std::function<void(int, int, int)>& func,
+                   int grain) {
+    Queue& own = queues_[idx];
+    // hungry from the first failed pop until a task is found
+    bool hungry = false;
+    while (remaining_.load(std::memory_order_acquire) > 0) {
+      Task task;
+      if (!own.pop_back(task)) {
+        if (!hungry) {
+          hungry_.fetch_add(1, std::memory_order_relaxed);
+          hungry = true;
+        }
+        if (!steal(idx, task)) {
+          std::this_thread::yield();
+          continue;
+        }
+      }
+      if (hungry) {
+        hungry_.fetch_sub(1, std::memory_order_relaxed);
+        hungry = false;
+      }
+
+      // give half of the task away if anyone is waiting for work
+      if (task.end - task.begin > grain &&
+          hungry_.load(std::memory_order_relaxed) > 0) {
+        const int mid = task.begin + (task.end - task.begin) / 2;
+        own.push_back({task.id, mid, task.end});
+        task.end = mid;
+        splits_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      func(task.id, task.begin, task.end);
+      remaining_.fetch_sub(task.end - task.begin, std::memory_order_release);
+    }
+    if (hungry) hungry_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  ThreadPool& pool_;
+  std::vector<Queue> queues_;
+  alignas(64) std::atomic<long> remaining_{0};
+  alignas(64) std::atomic<int> hungry_{0};
+  std::atomic<long> steals_{0};
+  std::atomic<long> splits_{0};
+};
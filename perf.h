@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// hardware counters of the calling thread, counted as one group around a
+// code region, user space only
+// - the events of the perf stat targets of the Makefile, armv8 pmu common
+//   event numbers for those without a generic perf event
+// - available() is false if the group leader (cycles) cannot be opened, e.g.
+//   no pmu in a vm or perf_event_paranoid > 2; other events that cannot be
+//   opened are left out and read as -1
+// - counts are scaled by time enabled / time running if the group was
+//   multiplexed, -1 if it never ran
+class PerfCounters {
+ public:
+  enum Event {
+    cycles, instructions, l1d_refill, l2d_refill, branch_misses, ase_spec,
+    n_events
+  };
+
+  static const char* name(int event) {
+    static const char* const names[] = {
+      "cycles", "instructions", "L1D_CACHE_REFILL", "L2D_CACHE_REFILL",
+      "BR_MIS_PRED_RETIRED", "ASE_SPEC",
+    };
+    return names[event];
+  }
+
+  PerfCounters() {
+    const struct {
+      uint32_t type;
+      uint64_t config;
+    } events[n_events] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_RAW, 0x03},  // L1D_CACHE_REFILL
+      {PERF_TYPE_RAW, 0x17},  // L2D_CACHE_REFILL
+      {PERF_TYPE_RAW, 0x22},  // BR_MIS_PRED_RETIRED
+      {PERF_TYPE_RAW, 0x74},  // ASE_SPEC
+    };
+    for (int i = 0; i < n_events; ++i) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.disabled = leader_ < 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0);
+      if (fd < 0) {
+        if (i == 0) {
+          error_ = std::strerror(errno);
+          return;
+        }
+        continue;
+      }
+      if (i == 0) leader_ = fd;
+      fds_[i] = fd;
+      slot_[i] = opened_++;
+    }
+  }
+
+  ~PerfCounters() {
+    for (const int fd : fds_) {
+      if (fd >= 0) close(fd);
+    }
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool available() const { return leader_ >= 0; }
+  // why the counters are not available
+  const std::string& error() const { return error_; }
+
+  void start() {
+    if (leader_ < 0) return;
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  void stop() {
+    for (double& count : counts_) count = -1;
+    if (leader_ < 0) return;
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time enabled, time running, one value per opened event
+    uint64_t data[3 + n_events];
+    if (read(leader_, data, sizeof(data)) < 0 || data[2] == 0) return;
+    const double scale = static_cast<double>(data[1]) / data[2];
+    for (int i = 0; i < n_events; ++i) {
+      if (fds_[i] >= 0) counts_[i] = data[3 + slot_[i]] * scale;
+    }
+  }
+
+  // count of the last start() ~ stop(), -1 if not counted
+  double operator[](int event) const { return counts_[event]; }
+
+ private:
+  int leader_ = -1;
+  int opened_ = 0;
+  int fds_[n_events] = {-1, -1, -1, -1, -1, -1};
+  int slot_[n_events] = {};
+  double counts_[n_events] = {-1, -1, -1, -1, -1, -1};
+  std::string error_;
+};